@@ -0,0 +1,3 @@
+-- A grouped aggregate computed by the scan
+SELECT run, count(*), sum(b0), min(b1), max(b2), avg(b3)
+FROM root_bench.events GROUP BY run;
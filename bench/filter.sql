@@ -0,0 +1,4 @@
+-- A condition checked by the cursor loop, passing the fraction selectivity
+-- of the entries (pgbench -D selectivity=0.01)
+SELECT count(*) FROM (SELECT b0, b2 FROM root_bench.events
+                      WHERE b1 < :selectivity OFFSET 0) s;
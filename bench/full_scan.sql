@@ -0,0 +1,2 @@
+-- Every entry with a few branches goes through the executor
+SELECT count(*) FROM (SELECT run, b0, b1, b2, b3 FROM root_bench.events OFFSET 0) s;
@@ -0,0 +1,5 @@
+-- Events joined with their muons in a single scan
+SELECT count(*) FROM (SELECT e.b0, m.muon_pt
+                      FROM root_bench.events e
+                      JOIN root_bench.events_muon m USING (events_id)
+                      WHERE m.muon_pt > 20 OFFSET 0) s;
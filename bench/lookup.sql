@@ -0,0 +1,4 @@
+-- Parameterized lookups of scattered tree ids
+SELECT count(*)
+FROM (SELECT (i * 7919) % 1000 AS id FROM generate_series(1, 100) i) v
+JOIN root_bench.events e ON e.events_id = v.id;
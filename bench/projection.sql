@@ -0,0 +1,2 @@
+-- A single branch of a wide tree
+SELECT count(*) FROM (SELECT b0 FROM root_bench.events OFFSET 0) s;
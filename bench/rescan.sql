@@ -0,0 +1,7 @@
+-- The inner side of a nested loop, scanned again for each outer row
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+SET enable_material = off;
+SELECT count(*)
+FROM generate_series(0, 3) g
+JOIN root_bench.events e ON e.run = g AND e.b1 < :selectivity;
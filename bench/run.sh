@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# bench/run.sh
+#		Run the root_fdw benchmarks against the server psql connects to
+#
+# Generates the benchmark shard in $SHARDS_PATH with make_shard.C if it is
+# missing, imports it into schema root_bench, then runs each pgbench script
+# for BENCH_DURATION seconds, reporting transactions, entries and megabytes
+# of ROOT files read per second.  Entries and bytes come from
+# root_fdw_stats(), so they are only reported when root_fdw is in
+# shared_preload_libraries.
+#
+# With BENCH_BASELINE set to the output of an earlier run, exits with an
+# error if a benchmark got slower than BENCH_TOLERANCE times its baseline.
+
+set -e
+
+: "${SHARDS_PATH:?must be the SHARDS_PATH of the server}"
+
+BENCH_DIR=$(dirname "$0")
+BENCH_SHARD=${BENCH_SHARD:-1}
+BENCH_FILES=${BENCH_FILES:-8}
+BENCH_ENTRIES=${BENCH_ENTRIES:-1000000}
+BENCH_BRANCHES=${BENCH_BRANCHES:-16}
+BENCH_COMPRESSION=${BENCH_COMPRESSION:-101}
+BENCH_MUONS=${BENCH_MUONS:-4}
+BENCH_SELECTIVITY=${BENCH_SELECTIVITY:-0.01}
+BENCH_DURATION=${BENCH_DURATION:-30}
+BENCH_CLIENTS=${BENCH_CLIENTS:-1}
+BENCH_SCRIPTS=${BENCH_SCRIPTS:-"full_scan projection filter aggregate join rescan lookup"}
+BENCH_OUTPUT=${BENCH_OUTPUT:-bench_output.txt}
+BENCH_TOLERANCE=${BENCH_TOLERANCE:-0.9}
+PSQL="${PSQL:-psql} -X -q -v ON_ERROR_STOP=1"
+PGBENCH=${PGBENCH:-pgbench}
+
+if [ -n "$BENCH_REGENERATE" ] || [ ! -f "$SHARDS_PATH/shard-$BENCH_SHARD.files" ]
+then
+	echo "generating shard $BENCH_SHARD in $SHARDS_PATH"
+	root -b -q -l "$BENCH_DIR/make_shard.C(\"$SHARDS_PATH\", $BENCH_SHARD, $BENCH_FILES, $BENCH_ENTRIES, $BENCH_BRANCHES, $BENCH_COMPRESSION, $BENCH_MUONS)"
+fi
+
+$PSQL -v shard="$BENCH_SHARD" -f "$BENCH_DIR/setup.sql"
+
+# Entries and bytes read so far by scans of the benchmark tables
+stats()
+{
+	$PSQL -At -F ' ' -c "SELECT coalesce(sum(entries_read), 0),
+								coalesce(sum(bytes_read), 0)
+						 FROM root_fdw_stats()
+						 WHERE foreign_table::text LIKE 'root_bench.%'"
+}
+
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+
+printf '%-12s %12s %14s %10s\n' benchmark tps rows/s MB/s > "$BENCH_OUTPUT"
+for script in $BENCH_SCRIPTS
+do
+	before=$(stats)
+	start=$(date +%s.%N)
+	$PGBENCH -n -c "$BENCH_CLIENTS" -T "$BENCH_DURATION" \
+		-D selectivity="$BENCH_SELECTIVITY" \
+		-f "$BENCH_DIR/$script.sql" > "$log"
+	end=$(date +%s.%N)
+	after=$(stats)
+
+	tps=$(awk '/^tps/ { print $3; exit }' "$log")
+	echo "$script $tps $before $after $start $end" |
+		awk '{
+			t = $8 - $7;
+			printf "%-12s %12.2f %14.0f %10.1f\n",
+				   $1, $2, ($5 - $3) / t, ($6 - $4) / t / 1048576
+		}' | tee -a "$BENCH_OUTPUT"
+done
+
+if [ -n "$BENCH_BASELINE" ]
+then
+	awk -v tolerance="$BENCH_TOLERANCE" '
+		NR == FNR { if (FNR > 1) baseline[$1] = $2; next }
+		FNR > 1 && ($1 in baseline) && $2 < baseline[$1] * tolerance {
+			printf "%s is slower than its baseline: %.2f tps, was %.2f\n",
+				   $1, $2, baseline[$1];
+			slower = 1
+		}
+		END { exit slower }' "$BENCH_BASELINE" "$BENCH_OUTPUT"
+fi
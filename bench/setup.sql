@@ -0,0 +1,16 @@
+-- bench/setup.sql
+--		Create the tables of the benchmark shard in schema root_bench
+--
+-- Run by run.sh as psql -v shard=N -f bench/setup.sql.
+
+CREATE EXTENSION IF NOT EXISTS root_fdw;
+
+DROP SCHEMA IF EXISTS root_bench CASCADE;
+CREATE SCHEMA root_bench;
+
+DROP SERVER IF EXISTS root_bench_server CASCADE;
+CREATE SERVER root_bench_server FOREIGN DATA WRAPPER root_fdw;
+
+IMPORT FOREIGN SCHEMA :"shard" FROM SERVER root_bench_server INTO root_bench;
+
+ANALYZE root_bench.events;
@@ -0,0 +1,32 @@
+/* contrib/root_fdw/root_fdw--1.0--1.1.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION root_fdw UPDATE TO '1.1'" to load this file. \quit
+
+CREATE FUNCTION root_histogram(foreign_table regclass,
+                               branch text,
+                               nbins integer,
+                               lo float8,
+                               hi float8,
+                               filter text DEFAULT NULL)
+RETURNS TABLE (bin integer, low float8, high float8, entries bigint)
+AS 'MODULE_PATHNAME'
+LANGUAGE C VOLATILE;
+
+CREATE FUNCTION root_zone_map_build(foreign_table regclass)
+RETURNS integer
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION root_fdw_stats(OUT foreign_table regclass,
+                               OUT scans bigint,
+                               OUT files_read bigint,
+                               OUT files_cached bigint,
+                               OUT bytes_read bigint,
+                               OUT entries_read bigint,
+                               OUT entries_filtered bigint,
+                               OUT open_time float8,
+                               OUT scan_time float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
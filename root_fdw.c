@@ -13,31 +13,71 @@
 #include "postgres.h"
 
 #include <sys/stat.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "access/htup_details.h"
+#include "access/parallel.h"
 #include "access/reloptions.h"
+#include "access/skey.h"
 #include "access/sysattr.h"
+#include "access/xact.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_am.h"
 #include "catalog/pg_foreign_server.h"
 #include "catalog/pg_foreign_table.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_opfamily.h"
+#include "catalog/pg_type.h"
 #include "commands/copy.h"
 #include "commands/defrem.h"
 #include "commands/explain.h"
 #include "commands/vacuum.h"
 #include "foreign/fdwapi.h"
 #include "foreign/foreign.h"
+#include "funcapi.h"
+#include "lib/ilist.h"
+#include "lib/stringinfo.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
 #include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
+#include "optimizer/tlist.h"
 #include "optimizer/var.h"
+#include "parser/parsetree.h"
+#include "parser/scansup.h"
+#include "portability/instr_time.h"
+#include "port/atomics.h"
 #include "postmaster/bgworker.h"
+#include "storage/dsm.h"
 #include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "tcop/tcopprot.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/sampling.h"
+#include "utils/selfuncs.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
+#include "utils/typcache.h"
 
 #include "rootcursor.h"
 
@@ -51,22 +91,251 @@ void _PG_init(void);
 static char *ShardPath = NULL;
 
 /*
- * ROOT cursor instance per shard.
+ * ROOT instance of a file of a shard.  Open instances are kept in a list in
+ * least recently used order, and closed once more than
+ * root_fdw.max_open_files are open, unless cursors are still open on them.
  */
-#define MAXSHARDS 100
+typedef struct RootFile
+{
+	Root		   *root;			/* ROOT instance, or NULL */
+	int				pins;			/* number of cursors open on root */
+	dlist_node		lru_node;		/* position in root_lru, if open */
+	time_t			mtime;			/* modification time when root was opened */
+	off_t			size;			/* size of the file when root was opened */
+} RootFile;
+
+/*
+ * Files of a shard.  Each file gets its own ROOT instance, opened on demand,
+ * so that files can be scanned independently of each other (e.g. by parallel
+ * workers).  Tables spanning several shards see the files of all of them as
+ * a single shard, which shares the ROOT instances of its shards.
+ */
+typedef struct RootShard
+{
+	int				shard;			/* shard number (hash key, must be first),
+									 * or -1 for a set of shards */
+	int				nfiles;			/* number of files in shard */
+	char		  **fnames;			/* file names as listed in the catalog */
+	RootFile	  **files;			/* ROOT instance per file */
+	time_t			mtime;			/* modification time of catalog when read */
+	TimestampTz		checked;		/* when the catalog was last checked */
+	int				generation;		/* number of times catalog was read */
+	MemoryContext	cxt;			/* context of fnames and files, or NULL */
+} RootShard;
+
+/*
+ * Milliseconds between checks of the catalog of a shard for changes, so that
+ * planning a table of many shards doesn't stat every catalog each time.
+ */
+#define ROOT_SHARD_CHECK_INTERVAL	1000
+
+/*
+ * Most shards a table can span.
+ */
+#define ROOT_MAX_SHARDS	10000
+
+/*
+ * Shards used by this backend, by shard number, and their open ROOT
+ * instances, most recently used first.  The catalog of a shard is read
+ * again when it changes, unless files of the shard are being scanned.
+ */
+static HTAB *root_shards = NULL;
+static dlist_head root_lru = DLIST_STATIC_INIT(root_lru);
+static int	root_nopen = 0;
+
+/*
+ * Metadata of a ROOT table in a single file, shared by all backends when
+ * root_fdw is loaded through shared_preload_libraries.  This lets backends
+ * plan queries without opening each ROOT file of the shard, which means
+ * parsing its headers, keys and streamer information.  Entries are refreshed
+ * when the file's modification time or size change.
+ */
+typedef struct RootFileMetaKey
+{
+	char			fname[MAXPGPATH];	/* file name */
+	char			tree[NAMEDATALEN];	/* ROOT tree name */
+	bool			is_collection;		/* is collection? */
+} RootFileMetaKey;
+
+typedef struct RootFileMeta
+{
+	RootFileMetaKey key;			/* hash key (must be first) */
+	time_t			mtime;			/* modification time of file */
+	off_t			size;			/* size of file */
+	int64			entries;		/* number of entries of table in file */
+} RootFileMeta;
+
+/*
+ * Values of a branch for a chunk of ROOT_CACHE_CHUNK consecutive entries of
+ * a table in a file, shared by all backends when root_fdw.column_cache_size
+ * is set.  Scans of files whose chunks are all cached read the values from
+ * shared memory instead of decompressing baskets.  Values are kept as read
+ * from the cursor: tree ids without the offset of the file, floats as
+ * doubles and other types as integers.
+ *
+ * Chunks are held in blocks of shared memory, which are evicted by a clock
+ * sweep.  The chunk of the last entry of the file is marked, so that a scan
+ * knows where the file ends without opening it.
+ */
+#define ROOT_CACHE_CHUNK	8192
+
+typedef union RootCacheValue
+{
+	int64			ival;
+	double			fval;
+} RootCacheValue;
+
+typedef struct RootColumnKey
+{
+	RootFileMetaKey	file;			/* file and table */
+	char			branch[NAMEDATALEN];	/* ROOT branch name */
+	int32			atttype;		/* ROOT type the values were read as */
+	int32			chunk;			/* chunk number in the file */
+} RootColumnKey;
+
+typedef struct RootColumnChunk
+{
+	RootColumnKey	key;			/* hash key (must be first) */
+	time_t			mtime;			/* modification time of file */
+	off_t			size;			/* size of file */
+	int				block;			/* block holding the values */
+	int				nvalues;		/* number of values */
+	bool			last;			/* chunk of the last entry of the file? */
+} RootColumnChunk;
+
+typedef struct RootCacheBlock
+{
+	RootColumnKey	key;			/* chunk held, if used */
+	bool			used;			/* holds a chunk? */
+	uint8			usage;			/* clock sweep usage count */
+} RootCacheBlock;
+
+#define ROOT_CACHE_MAX_USAGE	5
+
+/*
+ * Work done by the scans of a foreign table, summed over all backends since
+ * the server started, or over the scans of this backend if root_fdw is not
+ * in shared_preload_libraries.  Times are in milliseconds.
+ */
+#define ROOT_STATS_MAX_TABLES	1024
+
+typedef struct RootTableStatsKey
+{
+	Oid				dbid;			/* database of the table */
+	Oid				relid;			/* foreign table */
+} RootTableStatsKey;
+
+typedef struct RootTableStats
+{
+	RootTableStatsKey key;			/* hash key (must be first) */
+	int64			scans;			/* scans started, rescans included */
+	int64			files_read;		/* files opened */
+	int64			files_cached;	/* files read from the column cache */
+	int64			bytes_read;		/* size of the files opened */
+	int64			entries_read;	/* entries read */
+	int64			entries_filtered;	/* entries rejected by the scan */
+	double			open_time;		/* time opening files */
+	double			scan_time;		/* time filling batches */
+} RootTableStats;
+
+typedef struct RootSharedState
+{
+	LWLock		   *lock;			/* protects root_metadata */
+	LWLock		   *column_lock;	/* protects the column cache */
+	LWLock		   *stats_lock;		/* protects root_table_stats */
+	int				clock_hand;		/* next block of the clock sweep */
+} RootSharedState;
+
+static RootSharedState *root_shared = NULL;
+static HTAB *root_metadata = NULL;
+static HTAB *root_column_cache = NULL;
+static RootCacheBlock *root_cache_blocks = NULL;
+static RootCacheValue *root_cache_data = NULL;
+static int	root_cache_nblocks = 0;
+static HTAB *root_table_stats = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/*
+ * Zone map of a table of a shard: the smallest and greatest value of each
+ * branch in each file, built by root_zone_map_build and stored next to the
+ * shard catalog.  Files whose zones exclude the values wanted by the
+ * conditions of a scan are skipped.  Zone maps are loaded once per backend
+ * and reloaded when their file changes.
+ */
+typedef struct RootZone
+{
+	char		   *branch;			/* ROOT branch name */
+	double			min;			/* smallest value, NaNs being greatest */
+	double			max;			/* greatest value */
+} RootZone;
+
+typedef struct RootFileZones
+{
+	time_t			mtime;			/* modification time of file when built */
+	off_t			size;			/* size of file when built */
+	int				nzones;			/* number of zones, 0 if unknown */
+	RootZone	   *zones;			/* zone per branch */
+} RootFileZones;
+
+typedef struct RootZoneMap
+{
+	char			path[MAXPGPATH];	/* zone map file */
+	time_t			mtime;			/* its modification time when loaded */
+	int				nfiles;			/* number of files in shard */
+	RootFileZones  *files;			/* zones of each file of the shard */
+	MemoryContext	cxt;			/* context holding the zone map */
+} RootZoneMap;
+
+typedef struct RootZoneFileEntry
+{
+	char			fname[MAXPGPATH];	/* hash key (must be first) */
+	int				file;			/* index of file in shard */
+} RootZoneFileEntry;
+
+static List *root_zone_maps = NIL;
+
+/*
+ * Maximum number of entries in the shared metadata cache.
+ */
+static int	RootMetadataCacheSize = 4096;
+
+/*
+ * Size of the shared cache of branch values, in kilobytes.
+ */
+static int	RootColumnCacheSize = 0;
+
+/*
+ * Number of files past the one being scanned to prefetch.
+ */
+static int	RootPrefetchFiles = 1;
 
-static Root *root_shard[MAXSHARDS];
+/*
+ * Number of ROOT instances kept open by a backend.
+ */
+static int	RootMaxOpenFiles = 256;
 
 /*
  * Contains ROOT attribute name and attribute type as defined in the table
- * options.
+ * options.  Array attributes of a tree are branches of its collection, read
+ * as one array per tree entry; their type is the type of the elements.
  */
 typedef struct RootAttr
 {
 	char				*attname;
 	RootAttributeType	atttype;
+	bool				isarray;
 } RootAttr;
 
+/*
+ * Entry of the index of a ROOT schema, keyed by lower-case attribute name.
+ */
+typedef struct RootAttrIndexEntry
+{
+	char			attname[NAMEDATALEN];	/* hash key */
+	RootAttr	   *attr;
+} RootAttrIndexEntry;
+
 /*
  * Contains attributes being requested and their position in the PostgreSQL
  * tuple.
@@ -74,32 +343,378 @@ typedef struct RootAttr
 typedef struct QueryAttr
 {
 	RootAttr	   *attr;
-	int				pos;
+	AttrNumber		attno;			/* attribute number in the table */
+	int				pos;			/* position in the tuple, or -1 */
 } QueryAttr;
 
+/*
+ * Restriction clause evaluated inside the ROOT cursor loop.  Only simple
+ * comparisons between a column and a constant are supported; the constant is
+ * kept as an integer or as a float depending on the column type.
+ */
+typedef struct RootQual
+{
+	AttrNumber			attno;		/* attribute number of the column */
+	int					index;		/* position of attribute in cursor */
+	RootAttributeType	atttype;	/* ROOT type of the column */
+	StrategyNumber		strategy;	/* btree strategy of the comparison */
+	bool				isfloat;	/* compare against fval instead of ival */
+	int64				ival;		/* integer or boolean constant */
+	double				fval;		/* floating-point constant */
+} RootQual;
+
 /*
  * FDW-specific planner information kept in RelOptInfo.fdw_private for a
  * foreign table.
  */
 typedef struct RootFdwPlanState
 {
-	int				shard;			/* shard number */
+	List		   *shards;			/* shard numbers, as an integer list */
 	char		   *tree;			/* ROOT tree name */
 	List		   *schema;			/* ROOT schema defined in 'options' */
+	RootAttr	  **columns;		/* ROOT attribute of each column, or NULL */
+	int				ncolumns;		/* number of columns of the table */
 	bool			is_collection;	/* is collection? */
-	RootTable	   *root_table;		/* ROOT table to read */
+	bool			readahead;		/* hint whole files to be read ahead? */
+	int				nfiles;			/* number of files in shard */
+	List		   *offsets;		/* first tree id of each file, and total */
+	double		   *entries;		/* entries of the table in each file */
+	double			bytes;			/* total size of files in bytes */
+	List		   *remote_conds;	/* conditions evaluated by the cursor loop */
+	List		   *local_conds;	/* conditions evaluated by the executor */
+	char		   *sorted_by;		/* branch entries are sorted by, or NULL */
+	AttrNumber		tree_attno;		/* tree id column, or InvalidAttrNumber */
+	AttrNumber		sorted_attno;	/* sorted_by column, or InvalidAttrNumber */
 	BlockNumber 	pages;			/* estimate of physical size */
 	double			ntuples;		/* estimate of number of rows */
 } RootFdwPlanState;
 
+/*
+ * FDW-specific planner information kept in RelOptInfo.fdw_private for a
+ * join between a tree table and a collection table of that tree.
+ */
+typedef struct RootFdwJoinState
+{
+	RelOptInfo	   *tree_rel;		/* tree side of the join */
+	RelOptInfo	   *coll_rel;		/* collection side of the join */
+	List		   *local_conds;	/* conditions evaluated by the executor */
+} RootFdwJoinState;
+
+/*
+ * Planner information of a foreign table derived from its options and the
+ * contents of its shards, cached per backend so that repeated planning
+ * neither parses options nor reads files.  Entries are rebuilt when the
+ * options of the table, its server or its wrapper change, when the table is
+ * altered, and when the catalog of one of its shards is read again.
+ *
+ * Plans must not point into the cache.  The context of a rebuilt entry is
+ * only deleted at the end of the transaction, as planner information copied
+ * from it may still be in use.
+ */
+typedef struct RootPlanCacheEntry
+{
+	Oid				relid;			/* hash key (must be first) */
+	bool			valid;			/* false once invalidated */
+	MemoryContext	cxt;			/* context holding state, or NULL */
+	RootFdwPlanState *state;		/* planner information of the table */
+	int			   *generations;	/* generations of the shards of state */
+} RootPlanCacheEntry;
+
+static HTAB *root_plan_cache = NULL;
+static List *root_plan_cache_garbage = NIL;
+
+/*
+ * Generations of shards replaced during the current transaction.  Shard sets
+ * of scans may still refer to their files, so they are only freed at the end
+ * of the transaction.
+ */
+static List *root_shard_garbage = NIL;
+
+/*
+ * Table described by the schema file of a shard, imported by IMPORT FOREIGN
+ * SCHEMA.
+ */
+typedef struct RootImportTable
+{
+	char		   *tree;			/* ROOT tree name */
+	char		   *collection;		/* collection of the tree, or NULL */
+	List		   *attrs;			/* RootAttr of each branch */
+	List		   *typenames;		/* ROOT type name of each branch */
+	char		   *sorted_by;		/* branch entries are sorted by, or NULL */
+} RootImportTable;
+
+/*
+ * Indexes of FDW-private information stored in fdw_private lists of
+ * ForeignScan plan nodes.  The list must be copyable by copyObject, since
+ * plans are handed to parallel workers.
+ */
+enum FdwScanPrivateIndex
+{
+	/* Shard numbers (as an integer list) */
+	FdwScanPrivateShards,
+	/* ROOT tree name (as a String node) */
+	FdwScanPrivateTree,
+	/* Whether table is a collection (as an integer Value node) */
+	FdwScanPrivateIsCollection,
+	/* List of attributes, each a list of name, type, attno, position, isarray */
+	FdwScanPrivateAttrs,
+	/* Integer list with the first tree id of each file, and their total */
+	FdwScanPrivateOffsets,
+	/* List of conditions checked by the cursor loop */
+	FdwScanPrivateRemoteExprs,
+	/* Whether whole files are hinted to be read ahead (as an integer Value node) */
+	FdwScanPrivateReadahead,
+	/* Aggregate scans only: list of outputs, each a list of kind, attno, type */
+	FdwScanPrivateOutputs,
+	/* Aggregate scans only: whether only count(*) is wanted (as an integer) */
+	FdwScanPrivateCountOnly
+};
+
+/*
+ * Join scans have a list of two such lists instead, one per joined table.
+ */
+enum FdwJoinPrivateIndex
+{
+	/* Private list of the scan of the tree table */
+	FdwJoinPrivateTree,
+	/* Private list of the scan of the collection table */
+	FdwJoinPrivateCollection
+};
+
+/*
+ * Work done by a parallel worker, summed over the times it was launched.
+ */
+typedef struct RootWorkerCounters
+{
+	int64			files_read;		/* files opened */
+	int64			files_cached;	/* files read from the column cache */
+	int64			bytes_read;		/* size of the files opened */
+	int64			entries_read;	/* entries read */
+	int64			entries_filtered;	/* entries rejected by the scan */
+	instr_time		open_time;		/* time opening files */
+	instr_time		scan_time;		/* time filling batches */
+	instr_time		convert_time;	/* time converting values, if timing */
+} RootWorkerCounters;
+
+/*
+ * Shared state of a parallel scan, kept in dynamic shared memory.  Workers
+ * claim whole files from the shard, and leave the work they did for the
+ * leader to count.
+ */
+typedef struct RootParallelScanData
+{
+	pg_atomic_uint32	next_file;		/* next file to be scanned */
+	int					nworkers;		/* number of workers planned */
+	RootWorkerCounters	workers[FLEXIBLE_ARRAY_MEMBER];	/* per worker */
+} RootParallelScanData;
+
+typedef RootParallelScanData *RootParallelScan;
+
+/*
+ * Converts the value of a cursor attribute for the current entry into a
+ * Datum.  Tree ids are offset by the first tree id of the file being scanned.
+ * Converters are resolved once per scan from the attribute types, and from
+ * the declared types of the columns they are stored in, so the cursor loop
+ * doesn't switch on the type of every value.
+ */
+typedef Datum (*RootConverter) (RootCursor *root_cursor, int attr,
+								int64 tree_offset);
+
+/*
+ * Converts a value read from the column cache into a Datum, as the
+ * RootConverter resolved for its column would have read it from the cursor.
+ */
+typedef Datum (*RootCacheConverter) (RootCacheValue value, int64 tree_offset);
+
+/*
+ * Cost of decompressing a byte of a branch, as a multiple of
+ * cpu_operator_cost.
+ */
+#define ROOT_DECOMPRESSION_COST 0.1
+
+/*
+ * Number of entries read from the cursor per call of fill_batch.
+ */
+#define ROOT_BATCH_SIZE 1024
+
+/*
+ * Batch of entries that passed the conditions checked by the cursor loop,
+ * buffered column by column.  Pass-by-reference values live in batch_cxt,
+ * which is reset when the batch is refilled.
+ */
+typedef struct RootBatch
+{
+	int				nrows;			/* Number of buffered entries */
+	int				next;			/* Next entry to return */
+	Datum		  **values;			/* Values per projected attribute */
+	MemoryContext	batch_cxt;		/* Context for pass-by-reference values */
+} RootBatch;
+
+/*
+ * Output column of a grouping query computed by the FDW: either the grouping
+ * column or an aggregate evaluated over the entries of the batch.
+ */
+typedef enum RootAggKind
+{
+	RootAggGroup,
+	RootAggCount,
+	RootAggSum,
+	RootAggMin,
+	RootAggMax,
+	RootAggAvg
+} RootAggKind;
+
+/*
+ * Cost of an aggregate transition done by the cursor loop, as a multiple of
+ * cpu_operator_cost.  Transitions are plain arithmetic on values of the
+ * batch, which is cheaper than calling transition functions.
+ */
+#define ROOT_AGG_TRANSITION_COST 0.5
+
+typedef struct RootAggOutput
+{
+	RootAggKind			kind;		/* aggregate, or grouping column */
+	AttrNumber			attno;		/* input column, or 0 for count(*) */
+	Oid					type;		/* PostgreSQL type of the result */
+	int					column;		/* batch column of input, or -1 */
+	RootAttributeType	atttype;	/* ROOT type of input */
+} RootAggOutput;
+
+/*
+ * Transition state of an aggregate.  Integers are summed and compared as
+ * int64 and floats as doubles.
+ */
+typedef struct RootAggValue
+{
+	int64			count;			/* number of values aggregated */
+	int64			ival;			/* sum, min or max of integers */
+	double			fval;			/* sum, min or max of floats */
+} RootAggValue;
+
+typedef struct RootAggGroup
+{
+	int64			key;			/* hash key (must be first) */
+	RootAggValue	values[FLEXIBLE_ARRAY_MEMBER];	/* one per output */
+} RootAggGroup;
+
+/*
+ * State of an aggregate scan, which returns one row per group instead of
+ * one row per entry.
+ */
+typedef struct RootAggState
+{
+	RootAggOutput  *outputs;		/* output columns, in scan tlist order */
+	int				noutputs;		/* number of output columns */
+	int				group;			/* output of grouping column, or -1 */
+	int64			count_only;		/* count(*) of the files, or -1 */
+	HTAB		   *groups;			/* groups, if grouping */
+	RootAggGroup   *single;			/* the only group, if not grouping */
+	bool			done;			/* all entries aggregated? */
+	bool			emitted;		/* all groups returned? */
+	bool			scanning;		/* status is a scan in progress? */
+	HASH_SEQ_STATUS status;			/* scan of groups */
+} RootAggState;
+
+/*
+ * Reader of an array attribute of a tree scan.  The branch is read by a
+ * cursor on the collection of the tree in the file being scanned, which
+ * moves forward along with the tree cursor, and the elements of the entries
+ * of each tree entry are gathered into one array.
+ */
+typedef struct RootArrayReader
+{
+	char			   *attname;	/* ROOT name of the branch */
+	RootAttributeType	elemtype;	/* ROOT type of the elements */
+	int					pos;		/* Position in the tuple */
+	Oid					typid;		/* PostgreSQL type of the elements */
+	int16				typlen;
+	bool				typbyval;
+	char				typalign;
+	RootCursor		   *root_cursor;	/* Cursor on the collection, or NULL */
+	int64				cursor_id;	/* Tree id of the cursor's entry */
+	bool				pending;	/* Cursor's entry not consumed yet? */
+	Datum			   *elems;		/* Elements of the current tree entry */
+	int					maxelems;	/* Allocated size of elems */
+} RootArrayReader;
+
 /*
  * FDW-specific ignformation for ForeignScanState.fdw_state.
  */
 typedef struct RootFdwExecutionState
 {
-	RootCursor	   *root_cursor;	/* ROOT cursor */
+	MemoryContext	scan_cxt;		/* Context holding the state of the scan */
+	RootShard	   *shard;			/* Shard being scanned */
+	char		   *tree;			/* ROOT tree name */
+	bool			is_collection;	/* Is collection? */
+	int64		   *offsets;		/* First tree id of each file, and total */
+	RootParallelScan pscan;			/* Shared state, if parallel scan */
+	dsm_segment	   *pscan_seg;		/* Segment of pscan, in the leader, until
+									 * the workers' counters are collected */
+	int				next_file;		/* Next file to scan, if not parallel */
+	int				prefetched;		/* Files before this one were prefetched */
+	int				file;			/* File being scanned, or -1 */
+	RootCursor	   *root_cursor;	/* ROOT cursor on current file, or NULL */
+	bool			readahead;		/* Hint whole files to be read ahead? */
+	char		  **attnames;		/* ROOT names of attributes */
+	RootAttributeType *atttypes;	/* ROOT types of attributes */
+	AttrNumber	   *attnos;			/* Attribute numbers in the table */
 	int			   *pos;			/* List with positions of attributes to project */
 	int				nattrs;			/* Number of attributes */
+	int			   *proj;			/* Cursor attributes stored in the tuple */
+	int				nproj;			/* Number of attributes stored in the tuple */
+	RootConverter  *converters;		/* Converter per attribute stored */
+	bool			all_float;		/* Are all attributes stored floats? */
+	RootArrayReader *arrays;		/* Array attributes stored in the tuple */
+	int				narrays;		/* Number of array attributes */
+	int				tree_attr;		/* Cursor attribute of tree id, if arrays */
+	RootQual	   *quals;			/* Conditions checked before projecting */
+	int				nquals;			/* Number of conditions */
+	RootBatch		batch;			/* Entries waiting to be returned */
+	int				nbatches;		/* Number of batches filled */
+	bool			exhausted;		/* All files scanned? */
+	bool			lookup;			/* Looking up a tree id? */
+	ExprState	   *lookup_expr;	/* Tree id to look up */
+	Oid				lookup_type;	/* Type of lookup_expr */
+	int				lookup_attr;	/* Cursor attribute of the tree id */
+	int64			lookup_id;		/* Tree id being looked up */
+	int				lookup_file;	/* File holding lookup_id */
+	bool			param_pending;	/* lookup_id must be evaluated? */
+	int64			cursor_id;		/* Tree id of the cursor's entry */
+	bool			pending;		/* Cursor's entry not consumed yet? */
+	bool		   *skip;			/* Files excluded by zone map, or NULL */
+	int				first_file;		/* First file holding tree ids wanted */
+	int				last_file;		/* Last file holding tree ids wanted */
+	int				range_attr;		/* Cursor attribute of tree id, or -1 */
+	int64			max_id;			/* Last tree id wanted */
+	RootAggState   *agg;			/* Aggregates computed, or NULL */
+	struct RootFdwExecutionState *parent;	/* Tree scan joined, or NULL */
+	int				join_attr;		/* Cursor attribute of tree id, if joined */
+	bool			join_match;		/* Tree entry at cursor_id passes quals? */
+	bool			use_cache;		/* May files be read from the column cache? */
+	bool		   *cache_fill;		/* Attributes stored in the column cache */
+	RootCacheConverter *cache_converters;	/* Converter per attribute stored */
+	RootCacheValue **chunk;			/* Chunk of values per attribute */
+	bool			from_cache;		/* Current file read from the cache? */
+	bool			filling;		/* Current file filling the cache? */
+	struct stat		file_stat;		/* Status of current file, if either */
+	int64			entry;			/* Entries of current file read so far */
+	int64			fill_start;		/* First entry recorded for the cache */
+	int				chunk_next;		/* Next value of the chunk to return */
+	int				chunk_nvalues;	/* Number of values of the chunk */
+	bool			chunk_last;		/* Chunk of the last entry of the file? */
+	List		   *shards;			/* Shard numbers, for EXPLAIN */
+	Oid				relid;			/* Table the work is counted for */
+	bool			explain_only;	/* Plan only shown by EXPLAIN? */
+	bool			timing;			/* Time the conversion of values? */
+	int64			scans;			/* Scans started, rescans included */
+	int64			files_read;		/* Files opened */
+	int64			files_cached;	/* Files read from the column cache */
+	int64			bytes_read;		/* Size of the files opened */
+	int64			entries_read;	/* Entries read */
+	int64			entries_filtered;	/* Entries rejected by the scan */
+	instr_time		open_time;		/* Time opening files */
+	instr_time		scan_time;		/* Time filling batches */
+	instr_time		convert_time;	/* Time converting values, if timing */
 } RootFdwExecutionState;
 
 /*
@@ -107,9 +722,15 @@ typedef struct RootFdwExecutionState
  */
 extern Datum root_fdw_handler(PG_FUNCTION_ARGS);
 extern Datum root_fdw_validator(PG_FUNCTION_ARGS);
+extern Datum root_histogram(PG_FUNCTION_ARGS);
+extern Datum root_zone_map_build(PG_FUNCTION_ARGS);
+extern Datum root_fdw_stats(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(root_fdw_handler);
 PG_FUNCTION_INFO_V1(root_fdw_validator);
+PG_FUNCTION_INFO_V1(root_histogram);
+PG_FUNCTION_INFO_V1(root_zone_map_build);
+PG_FUNCTION_INFO_V1(root_fdw_stats);
 
 /*
  * FDW callback routines
@@ -125,27 +746,244 @@ static ForeignScan *rootGetForeignPlan(PlannerInfo *root,
 				   Oid foreigntableid,
 				   ForeignPath *best_path,
 				   List *tlist,
-				   List *scan_clauses);
+				   List *scan_clauses,
+				   Plan *outer_plan);
+static void rootGetForeignJoinPaths(PlannerInfo *root,
+						RelOptInfo *joinrel,
+						RelOptInfo *outerrel,
+						RelOptInfo *innerrel,
+						JoinType jointype,
+						JoinPathExtraData *extra);
+static void rootGetForeignUpperPaths(PlannerInfo *root,
+						 UpperRelationKind stage,
+						 RelOptInfo *input_rel,
+						 RelOptInfo *output_rel);
 static void rootBeginForeignScan(ForeignScanState *node, int eflags);
 static TupleTableSlot *rootIterateForeignScan(ForeignScanState *node);
 static void rootReScanForeignScan(ForeignScanState *node);
 static void rootEndForeignScan(ForeignScanState *node);
+static void rootExplainForeignScan(ForeignScanState *node, ExplainState *es);
+static bool rootAnalyzeForeignTable(Relation relation,
+						AcquireSampleRowsFunc *func,
+						BlockNumber *totalpages);
+static List *rootImportForeignSchema(ImportForeignSchemaStmt *stmt,
+						Oid serverOid);
+static bool rootIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
+							  RangeTblEntry *rte);
+static Size rootEstimateDSMForeignScan(ForeignScanState *node,
+						   ParallelContext *pcxt);
+static void rootInitializeDSMForeignScan(ForeignScanState *node,
+							 ParallelContext *pcxt,
+							 void *coordinate);
+static void rootReInitializeDSMForeignScan(ForeignScanState *node,
+							   ParallelContext *pcxt,
+							   void *coordinate);
+static void rootInitializeWorkerForeignScan(ForeignScanState *node,
+								shm_toc *toc,
+								void *coordinate);
 
 /*
  * Helper functions
  */
-static char **get_shard_contents(int shard, int *n);
+static void shard_file_path(char *path, int shard, const char *suffix);
+static char **get_shard_contents(int shard, int *n, time_t *mtime);
+static RootShard *get_root_shard(int shard);
+static List *read_shard_schema(int shard);
+static char *compare_shard_schemas(List *tables, List *other);
+static RootAttributeType parse_root_type(char *name, bool *isarray);
+static RootShard *get_shard_set(List *shards);
+static List *parse_shard_list(const char *value);
+static RootTable *get_file_table(RootShard *rshard, int file,
+								 const char *tree, bool is_collection);
+static void evict_file_roots(int nopen);
+static void close_shard_files(RootShard *rshard);
+static void root_xact_callback(XactEvent event, void *arg);
+static int64 get_file_entries(RootShard *rshard, int file,
+							  const char *tree, bool is_collection);
+static Size root_shmem_size(void);
+static void root_shmem_startup(void);
+static int	root_column_cache_blocks(void);
+static bool make_column_key(RootColumnKey *key, const char *fname,
+							const char *tree, bool is_collection,
+							const char *branch, RootAttributeType atttype,
+							int chunk);
+static int	get_cached_chunk(RootColumnKey *key, struct stat *st,
+							 RootCacheValue *values, bool *last);
+static void put_cached_chunk(RootColumnKey *key, struct stat *st,
+							 RootCacheValue *values, int nvalues, bool last);
+static void zone_map_path(char *path, int shard, const char *tree,
+						  bool is_collection);
+static RootZoneMap *get_zone_map(RootShard *rshard, int shard,
+								 const char *tree, bool is_collection);
+static bool *get_skipped_files(List *shards, const char *tree,
+							   bool is_collection, RootQual *quals,
+							   char **branches, int nquals);
+static bool zone_excludes(RootZone *zone, RootQual *qual);
+static double get_value_as_double(RootCursor *root_cursor, int attr,
+								  RootAttributeType atttype);
+static void check_root_table(Oid relid);
+static RootFdwPlanState *get_plan_state(Oid foreigntableid);
+static RootFdwPlanState *build_plan_state(Oid foreigntableid);
+static void invalidate_plan_cache(Datum arg, int cacheid, uint32 hashvalue);
+static void invalidate_plan_cache_rel(Datum arg, Oid relid);
+static List *build_scan_private(RootFdwPlanState *fdw_private, List *attrs,
+								List *remote_exprs);
+static List *serialize_attributes(List *attrs);
+static void resolve_columns(Oid foreigntableid,
+							  RootFdwPlanState *fdw_private);
+static List *get_column_pathkeys(PlannerInfo *root, RelOptInfo *baserel,
+								 Oid foreigntableid, AttrNumber attno);
+static void add_lookup_paths(PlannerInfo *root, RelOptInfo *baserel,
+							 RootFdwPlanState *fdw_private, List *attrs,
+							 List *private);
+static bool ec_member_matches_tree_id(PlannerInfo *root, RelOptInfo *rel,
+									  EquivalenceClass *ec,
+									  EquivalenceMember *em, void *arg);
+static Expr *get_tree_id_param(RestrictInfo *rinfo, RelOptInfo *baserel,
+							   AttrNumber tree_attno);
+static bool is_tree_id_join_clause(RestrictInfo *rinfo,
+								   RelOptInfo *tree_rel, AttrNumber tree_attno,
+								   RelOptInfo *coll_rel, AttrNumber coll_attno);
+static ForeignScan *create_join_plan(PlannerInfo *root, RelOptInfo *joinrel,
+									 List *tlist);
+static List *build_join_scan_private(PlannerInfo *root, RelOptInfo *rel,
+									 List *fdw_scan_tlist);
+static List *build_root_agg(Expr *expr, bool is_group, RelOptInfo *input_rel,
+							RootFdwPlanState *fdw_private, Oid foreigntableid);
+static ForeignScan *create_aggregate_plan(RelOptInfo *upperrel,
+										  ForeignPath *best_path,
+										  List *tlist);
+static double get_shard_bytes(RootShard *rshard);
+static int root_acquire_sample_rows(Relation onerel, int elevel,
+						 HeapTuple *rows, int targrows,
+						 double *totalrows, double *totaldeadrows);
 static void rootGetOptions(Oid foreigntableid,
-						   int *shard, char **tree,
-						   List **schema, bool *is_collection);
+						   List **shards, char **tree,
+						   List **schema, bool *is_collection,
+						   bool *readahead, char **sorted_by);
+static RootAttr *find_root_attr(List *schema, const char *attname);
+static RootAttr *get_root_attr(RootFdwPlanState *fdw_private,
+							   AttrNumber attno);
+static void classify_conditions(RelOptInfo *baserel,
+								RootFdwPlanState *fdw_private,
+								Oid foreigntableid);
+static bool is_root_column(Node *node, Index relid);
+static bool build_root_qual(Expr *clause, Index relid, RootQual *qual);
+static int	root_float_cmp(double a, double b);
+static void narrow_tree_id_range(RootQual *qual, int64 *min_id,
+								 int64 *max_id);
+static int	find_tree_id_file(int64 *offsets, int nfiles, int64 id);
+static bool root_qual_matches(RootCursor *root_cursor, RootQual *qual,
+							  int64 tree_offset);
+static bool root_qual_matches_value(RootQual *qual, RootCacheValue value,
+									int64 tree_offset);
+static bool root_qual_holds(RootQual *qual, int64 ival, double fval);
 static List *collect_attributes(RelOptInfo *baserel,
 								RootFdwPlanState *fdw_private,
 								Oid foreigntableid);
 static void estimate_size(PlannerInfo *root, RelOptInfo *baserel,
 			  RootFdwPlanState *fdw_private);
 static void estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
-			   RootFdwPlanState *fdw_private,
+			   RootFdwPlanState *fdw_private, List *attrs,
+			   double parallel_divisor,
 			   Cost *startup_cost, Cost *total_cost);
+static void estimate_read_size(RootFdwPlanState *fdw_private, List *attrs,
+				   double *pages, double *width);
+static int	root_type_width(RootAttributeType atttype);
+static double root_parallel_divisor(int parallel_workers);
+static Datum convert_tree_id(RootCursor *root_cursor, int attr,
+							 int64 tree_offset);
+static Datum convert_collection_id(RootCursor *root_cursor, int attr,
+								   int64 tree_offset);
+static Datum convert_int(RootCursor *root_cursor, int attr, int64 tree_offset);
+static Datum convert_uint(RootCursor *root_cursor, int attr, int64 tree_offset);
+static Datum convert_float(RootCursor *root_cursor, int attr,
+						   int64 tree_offset);
+static Datum convert_bool(RootCursor *root_cursor, int attr, int64 tree_offset);
+static Datum convert_int_to_int2(RootCursor *root_cursor, int attr,
+								 int64 tree_offset);
+static Datum convert_int_to_int8(RootCursor *root_cursor, int attr,
+								 int64 tree_offset);
+static Datum convert_int_to_float4(RootCursor *root_cursor, int attr,
+								   int64 tree_offset);
+static Datum convert_int_to_float8(RootCursor *root_cursor, int attr,
+								   int64 tree_offset);
+static Datum convert_uint_to_int4(RootCursor *root_cursor, int attr,
+								  int64 tree_offset);
+static Datum convert_uint_to_int8(RootCursor *root_cursor, int attr,
+								  int64 tree_offset);
+static Datum convert_float_to_float4(RootCursor *root_cursor, int attr,
+									 int64 tree_offset);
+static RootConverter get_root_converter(RootAttributeType atttype);
+static RootConverter get_column_converter(RootAttributeType atttype,
+										  Oid typid);
+static void resolve_column_converters(RootFdwExecutionState *festate,
+									  TupleDesc tupdesc);
+static Datum convert_cached_tree_id(RootCacheValue value, int64 tree_offset);
+static Datum convert_cached_int(RootCacheValue value, int64 tree_offset);
+static Datum convert_cached_uint(RootCacheValue value, int64 tree_offset);
+static Datum convert_cached_float(RootCacheValue value, int64 tree_offset);
+static Datum convert_cached_bool(RootCacheValue value, int64 tree_offset);
+static Datum convert_cached_int_to_int2(RootCacheValue value,
+										int64 tree_offset);
+static Datum convert_cached_int_to_int8(RootCacheValue value,
+										int64 tree_offset);
+static Datum convert_cached_int_to_float4(RootCacheValue value,
+										  int64 tree_offset);
+static Datum convert_cached_int_to_float8(RootCacheValue value,
+										  int64 tree_offset);
+static Datum convert_cached_uint_to_int4(RootCacheValue value,
+										 int64 tree_offset);
+static Datum convert_cached_float_to_float4(RootCacheValue value,
+											int64 tree_offset);
+static RootCacheConverter get_cached_converter(RootConverter converter);
+static RootFdwExecutionState *create_execution_state(List *fdw_private,
+													 MemoryContext cxt);
+static RootFdwExecutionState *create_join_state(List *fdw_private,
+												MemoryContext cxt);
+static int	find_tree_id_attr(RootFdwExecutionState *festate);
+static bool join_tree_entry(RootFdwExecutionState *tree_state, int64 id);
+static Datum read_array(RootArrayReader *reader, int64 id);
+static Datum get_array_elem(RootCursor *root_cursor,
+							RootAttributeType elemtype);
+static Oid get_array_elem_type(RootAttributeType elemtype);
+static RootAggState *create_agg_state(RootFdwExecutionState *festate,
+									  List *outputs, int64 count_only,
+									  MemoryContext cxt);
+static int	fill_batch(RootFdwExecutionState *festate);
+static void start_lookup(ForeignScanState *node,
+						 RootFdwExecutionState *festate);
+static TupleTableSlot *iterate_aggregate(RootFdwExecutionState *festate,
+										 TupleTableSlot *slot);
+static void aggregate_entries(RootFdwExecutionState *festate);
+static void advance_agg(RootAggValue *value, RootAggOutput *output,
+						Datum *column, int nrows);
+static int64 root_datum_get_int64(Datum value, RootAttributeType atttype);
+static List *plan_histogram_scan(Oid relid, const char *branch,
+								 const char *filter);
+static int	build_shard_zone_map(RootFdwPlanState *fdw_private, int shard,
+								 RootAttr **branches, int nbranches);
+static void bin_values(Datum *column, int nrows, RootAttributeType atttype,
+					   double lo, double hi, int nbins, int64 *counts);
+static bool open_next_file(RootFdwExecutionState *festate);
+static void open_file_cursor(RootFdwExecutionState *festate, int file);
+static void advise_file(const char *fname);
+static void prefetch_files(RootFdwExecutionState *festate);
+static void close_current_file(RootFdwExecutionState *festate);
+static char *describe_shards(List *shards);
+static char *describe_root_qual(RootFdwExecutionState *festate,
+								RootQual *qual);
+static void record_table_stats(RootFdwExecutionState *festate);
+static void store_worker_counters(RootFdwExecutionState *festate);
+static void collect_worker_counters(dsm_segment *seg, Datum arg);
+static bool open_cached_file(RootFdwExecutionState *festate, int file);
+static bool load_cached_chunk(RootFdwExecutionState *festate, int chunk);
+static void resume_file_cursor(RootFdwExecutionState *festate);
+static RootCacheValue get_cache_value(RootCursor *root_cursor, int attr,
+									  RootAttributeType atttype);
+static void fill_cached_entry(RootFdwExecutionState *festate,
+							  RootCursor *root_cursor);
+static void flush_cached_chunk(RootFdwExecutionState *festate, bool last);
 
 /*
  * Plugin initializer.
@@ -153,12 +991,193 @@ static void estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
 void
 _PG_init(void)
 {
-	int i;
+	DefineCustomIntVariable("root_fdw.max_open_files",
+							"Sets the maximum number of ROOT files kept open by a backend.",
+							"Least recently used files are closed first; files being scanned are never closed.",
+							&RootMaxOpenFiles,
+							256,
+							1,
+							INT_MAX / 2,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("root_fdw.prefetch_files",
+							"Sets the number of ROOT files to prefetch ahead of the one being scanned.",
+							"Zero disables prefetching.",
+							&RootPrefetchFiles,
+							1,
+							0,
+							64,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	/*
+	 * Pins of cursors lost by an aborted scan must not keep files open, and
+	 * rebuilt plan cache entries are freed once no planning uses them.
+	 */
+	RegisterXactCallback(root_xact_callback, NULL);
+
+	/*
+	 * The shared metadata cache is only available if we are loaded through
+	 * shared_preload_libraries.  Otherwise each backend opens the ROOT files
+	 * it plans queries on.
+	 */
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomIntVariable("root_fdw.metadata_cache_size",
+							"Sets the maximum number of ROOT tables cached in shared memory.",
+							"Each entry holds the metadata of a tree or collection in one file.",
+							&RootMetadataCacheSize,
+							4096,
+							64,
+							INT_MAX / 2,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("root_fdw.column_cache_size",
+							"Sets the amount of shared memory caching values of ROOT branches.",
+							"Zero disables the cache.",
+							&RootColumnCacheSize,
+							0,
+							0,
+							MAX_KILOBYTES,
+							PGC_POSTMASTER,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
+	EmitWarningsOnPlaceholders("root_fdw");
+
+	RequestAddinShmemSpace(root_shmem_size());
+	RequestNamedLWLockTranche("root_fdw", 3);
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = root_shmem_startup;
+}
+
+/*
+ * Estimate shared memory space needed.
+ */
+static Size
+root_shmem_size(void)
+{
+	Size		size;
+	int			nblocks;
+
+	size = MAXALIGN(sizeof(RootSharedState));
+	size = add_size(size, hash_estimate_size(RootMetadataCacheSize,
+											 sizeof(RootFileMeta)));
+	size = add_size(size, hash_estimate_size(ROOT_STATS_MAX_TABLES,
+											 sizeof(RootTableStats)));
+
+	/* Column cache: its chunks, their blocks and the values they hold */
+	nblocks = root_column_cache_blocks();
+	if (nblocks > 0)
+	{
+		size = add_size(size, hash_estimate_size(nblocks,
+												 sizeof(RootColumnChunk)));
+		size = add_size(size, mul_size(nblocks, sizeof(RootCacheBlock)));
+		size = add_size(size, mul_size(mul_size(nblocks, ROOT_CACHE_CHUNK),
+									   sizeof(RootCacheValue)));
+	}
+
+	return size;
+}
+
+/*
+ * Number of blocks of the column cache, each holding a chunk of values.
+ */
+static int
+root_column_cache_blocks(void)
+{
+	return (int) ((int64) RootColumnCacheSize * 1024 /
+				  (ROOT_CACHE_CHUNK * sizeof(RootCacheValue)));
+}
+
+/*
+ * Allocate or attach to shared memory.
+ */
+static void
+root_shmem_startup(void)
+{
+	HASHCTL		info;
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	root_shared = ShmemInitStruct("root_fdw", sizeof(RootSharedState), &found);
+	if (!found)
+	{
+		LWLockPadded *locks = GetNamedLWLockTranche("root_fdw");
+
+		root_shared->lock = &locks[0].lock;
+		root_shared->column_lock = &locks[1].lock;
+		root_shared->stats_lock = &locks[2].lock;
+		root_shared->clock_hand = 0;
+	}
 
-	for (i = 0; i < MAXSHARDS; i++)
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(RootFileMetaKey);
+	info.entrysize = sizeof(RootFileMeta);
+	root_metadata = ShmemInitHash("root_fdw file metadata",
+								  RootMetadataCacheSize,
+								  RootMetadataCacheSize,
+								  &info,
+								  HASH_ELEM | HASH_BLOBS);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(RootTableStatsKey);
+	info.entrysize = sizeof(RootTableStats);
+	root_table_stats = ShmemInitHash("root_fdw table stats",
+									 ROOT_STATS_MAX_TABLES,
+									 ROOT_STATS_MAX_TABLES,
+									 &info,
+									 HASH_ELEM | HASH_BLOBS);
+
+	root_cache_nblocks = root_column_cache_blocks();
+	if (root_cache_nblocks > 0)
 	{
-		root_shard[i] = NULL;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(RootColumnKey);
+		info.entrysize = sizeof(RootColumnChunk);
+		root_column_cache = ShmemInitHash("root_fdw column cache",
+										  root_cache_nblocks,
+										  root_cache_nblocks,
+										  &info,
+										  HASH_ELEM | HASH_BLOBS);
+
+		root_cache_blocks = (RootCacheBlock *)
+			ShmemInitStruct("root_fdw column cache blocks",
+							mul_size(root_cache_nblocks,
+									 sizeof(RootCacheBlock)),
+							&found);
+		if (!found)
+			memset(root_cache_blocks, 0,
+				   root_cache_nblocks * sizeof(RootCacheBlock));
+
+		root_cache_data = (RootCacheValue *)
+			ShmemInitStruct("root_fdw column cache data",
+							mul_size(mul_size(root_cache_nblocks,
+											  ROOT_CACHE_CHUNK),
+									 sizeof(RootCacheValue)),
+							&found);
 	}
+
+	LWLockRelease(AddinShmemInitLock);
 }
 
 /*
@@ -177,6 +1196,24 @@ root_fdw_handler(PG_FUNCTION_ARGS)
 	fdwroutine->IterateForeignScan = rootIterateForeignScan;
 	fdwroutine->ReScanForeignScan = rootReScanForeignScan;
 	fdwroutine->EndForeignScan = rootEndForeignScan;
+	fdwroutine->ExplainForeignScan = rootExplainForeignScan;
+	fdwroutine->AnalyzeForeignTable = rootAnalyzeForeignTable;
+
+	/* Support functions for IMPORT FOREIGN SCHEMA */
+	fdwroutine->ImportForeignSchema = rootImportForeignSchema;
+
+	/* Support functions for join push-down */
+	fdwroutine->GetForeignJoinPaths = rootGetForeignJoinPaths;
+
+	/* Support functions for upper relation push-down */
+	fdwroutine->GetForeignUpperPaths = rootGetForeignUpperPaths;
+
+	/* Support functions for parallel scans */
+	fdwroutine->IsForeignScanParallelSafe = rootIsForeignScanParallelSafe;
+	fdwroutine->EstimateDSMForeignScan = rootEstimateDSMForeignScan;
+	fdwroutine->InitializeDSMForeignScan = rootInitializeDSMForeignScan;
+	fdwroutine->ReInitializeDSMForeignScan = rootReInitializeDSMForeignScan;
+	fdwroutine->InitializeWorkerForeignScan = rootInitializeWorkerForeignScan;
 
 	PG_RETURN_POINTER(fdwroutine);
 }
@@ -193,9 +1230,12 @@ root_fdw_validator(PG_FUNCTION_ARGS)
 	List	   *options = untransformRelOptions(PG_GETARG_DATUM(0));
 	Oid			catalog = PG_GETARG_OID(1);
 	int			shard = -1;
+	char	   *shards = NULL;
 	char	   *tree = NULL;
 	char	   *collection = NULL;
 	int			nattrs = -1;
+	char	   *io_mode = NULL;
+	char	   *sorted_by = NULL;
 	ListCell   *cell;
 
 	foreach(cell, options)
@@ -212,6 +1252,22 @@ root_fdw_validator(PG_FUNCTION_ARGS)
 			}
 			shard = strtod(defGetString(def), NULL);
 		}
+		else if (strcmp(def->defname, "shards") == 0)
+		{
+			if (shards)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options: 'shards'")));
+			}
+			shards = defGetString(def);
+			if (parse_shard_list(shards) == NIL)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("'shards' option must be a list of shard numbers or ranges in root_fdw")));
+			}
+		}
 		else if (strcmp(def->defname, "tree") == 0)
 		{
 			if (tree)
@@ -241,21 +1297,52 @@ root_fdw_validator(PG_FUNCTION_ARGS)
 			}
 			nattrs = strtod(defGetString(def), NULL);
 		}
+		else if (strcmp(def->defname, "io_mode") == 0)
+		{
+			if (io_mode)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options: 'io_mode'")));
+			}
+			io_mode = defGetString(def);
+			if (strcmp(io_mode, "buffered") != 0 &&
+				strcmp(io_mode, "readahead") != 0)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("'io_mode' option must be 'buffered' or 'readahead' in root_fdw")));
+			}
+		}
+		else if (strcmp(def->defname, "sorted_by") == 0)
+		{
+			if (sorted_by)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options: 'sorted_by'")));
+			}
+			sorted_by = defGetString(def);
+		}
 	}
 
-	/* shard option is required for root_fdw foreign tables */
-	if (catalog == ForeignServerRelationId && shard == -1)
+	/*
+	 * shard option must only be presented as a root_fdw server option.  It
+	 * may be left out for servers of tables giving their own shards.
+	 */
+	if (catalog != ForeignServerRelationId && shard != -1)
 	{
 		ereport(ERROR,
 				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-				 errmsg("'shard' option is required as a root_fdw server option")));
+				 errmsg("'shard' option can only be used as a root_fdw server option")));
 	}
-	/* shard option must only be presented as a root_fdw server option */
-	else if (catalog != ForeignServerRelationId && shard != -1)
+
+	/* shards option must only be presented as a root_fdw foreign table option */
+	if (catalog != ForeignTableRelationId && shards != NULL)
 	{
 		ereport(ERROR,
 				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-				 errmsg("'shard' option can only be used as a root_fdw server option")));
+				 errmsg("'shards' option can only be used as a root_fdw table option")));
 	}
 
 	/* tree option is required for root_fdw foreign tables */
@@ -296,21 +1383,32 @@ root_fdw_validator(PG_FUNCTION_ARGS)
 				 errmsg("'nattrs' option can only be used as a root_fdw table option")));
 	}
 
+	/* io_mode option must only be presented as a root_fdw server or table option */
+	if (catalog != ForeignServerRelationId && catalog != ForeignTableRelationId &&
+		io_mode != NULL)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+				 errmsg("'io_mode' option can only be used as a root_fdw server or table option")));
+	}
+
+	/* sorted_by option must only be presented as a root_fdw foreign table option */
+	if (catalog != ForeignTableRelationId && sorted_by != NULL)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+				 errmsg("'sorted_by' option can only be used as a root_fdw table option")));
+	}
+
 	PG_RETURN_VOID();
 }
 
 /*
- * Get shard contents from catalog.
+ * Build the path of a file describing a shard, such as its catalog.
  */
-static char
-**get_shard_contents(int shard, int *n)
+static void
+shard_file_path(char *path, int shard, const char *suffix)
 {
-	FILE   *f;
-	char  **fnames = NULL;
-	int		siz = 0;
-	char	path[1024];
-	char	buf[1024];
-
 	if (ShardPath == NULL)
 	{
 		ShardPath = getenv("SHARDS_PATH");
@@ -322,15 +1420,33 @@ static char
 		}
 	}
 
-	sprintf(path, "%s/shard-%d.files", ShardPath, shard);
-
-	f = AllocateFile(path, "r");
-	if (!f)
-	{
-		ereport(FATAL,
-				(errcode_for_file_access(),
-				 errmsg("could not open file \"%s\": %m", path)));
-	}
+	snprintf(path, MAXPGPATH, "%s/shard-%d.%s", ShardPath, shard, suffix);
+}
+
+/*
+ * Get shard contents from catalog, and the modification time of the catalog.
+ */
+static char
+**get_shard_contents(int shard, int *n, time_t *mtime)
+{
+	FILE   *f;
+	char  **fnames = NULL;
+	int		siz = 0;
+	char	path[MAXPGPATH];
+	char	buf[1024];
+	struct stat st;
+
+	shard_file_path(path, shard, "files");
+
+	f = AllocateFile(path, "r");
+	if (!f)
+	{
+		ereport(FATAL,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", path)));
+	}
+
+	*mtime = (fstat(fileno(f), &st) == 0) ? st.st_mtime : 0;
 
 	*n = 0;
 	while (fgets(buf, 1024, f) != NULL)
@@ -376,591 +1492,6805 @@ static char
 }
 
 /*
- * Fetch the options for a root_fdw foreign table.
+ * Read the schema file of a shard, describing the trees and collections of
+ * its files for IMPORT FOREIGN SCHEMA.
+ *
+ * Each line holds a tree name, or a tree and collection name separated by a
+ * dot, a branch name and its ROOT type, and optionally the word "sorted" if
+ * entries are sorted by the branch.  Empty lines and lines starting with '#'
+ * are ignored.  Returns a list of RootImportTable in order of appearance.
  */
-static void
-rootGetOptions(Oid foreigntableid,
-			   int *shard, char **tree,
-			   List **schema, bool *is_collection)
+static List *
+read_shard_schema(int shard)
 {
-	ForeignTable 	   *table;
-	ForeignServer 	   *server;
-	ForeignDataWrapper *wrapper;
-	List	   		   *options;
-	ListCell   		   *cell;
-	char			   *collection = NULL;
-	int					nattrs = -1;
-	RootAttr		   *attr;
-	int					len;
+	FILE	   *f;
+	List	   *tables = NIL;
+	char		path[MAXPGPATH];
+	char		buf[1024];
+	int			lineno = 0;
 
-	/*
-	 * Default uninitialized values for options.
-	 */
-	*shard = -1;
-	*tree = NULL;
-	*schema = NIL;
-	*is_collection = false;
-
-	/*
-	 * Extract options from FDW objects.  We ignore user mappings because
-	 * root_fdw doesn't have any options that can be specified there.
-	 *
-	 * (XXX Actually, given the current contents of valid_options[], there's
-	 * no point in examining anything except the foreign table's own options.
-	 * Simplify?)
-	 */
-	table = GetForeignTable(foreigntableid);
-	server = GetForeignServer(table->serverid);
-	wrapper = GetForeignDataWrapper(server->fdwid);
+	shard_file_path(path, shard, "schema");
 
-	options = NIL;
-	options = list_concat(options, wrapper->options);
-	options = list_concat(options, server->options);
-	options = list_concat(options, table->options);
+	f = AllocateFile(path, "r");
+	if (!f)
+	{
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", path)));
+	}
 
-	foreach(cell, options)
+	while (fgets(buf, sizeof(buf), f) != NULL)
 	{
-		DefElem    *def = (DefElem *) lfirst(cell);
+		RootImportTable *table = NULL;
+		RootAttr   *attr;
+		char	   *name;
+		char	   *collection;
+		char	   *branch;
+		char	   *type;
+		char	   *flag;
+		char	   *saveptr;
+		ListCell   *lc;
 
-		if (strcmp(def->defname, "shard") == 0)
+		lineno++;
+
+		name = strtok_r(buf, " \t\r\n", &saveptr);
+		if (name == NULL || name[0] == '#')
+			continue;
+		branch = strtok_r(NULL, " \t\r\n", &saveptr);
+		type = branch ? strtok_r(NULL, " \t\r\n", &saveptr) : NULL;
+		flag = type ? strtok_r(NULL, " \t\r\n", &saveptr) : NULL;
+
+		if (type == NULL || (flag != NULL && strcmp(flag, "sorted") != 0))
 		{
-			*shard = strtod(defGetString(def), NULL);
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_ERROR),
+					 errmsg("invalid line %d in schema file \"%s\"",
+							lineno, path)));
 		}
-		else if (strcmp(def->defname, "tree") == 0)
+
+		collection = strchr(name, '.');
+		if (collection)
+			*collection++ = '\0';
+
+		/* Arrays belong to trees and don't order their entries */
+		attr = (RootAttr *) palloc(sizeof(RootAttr));
+		attr->attname = pstrdup(branch);
+		attr->atttype = parse_root_type(type, &attr->isarray);
+		if (attr->atttype == RootInvalidType ||
+			attr->atttype == RootTreeId || attr->atttype == RootCollectionId ||
+			(attr->isarray && (collection != NULL || flag != NULL)))
 		{
-			*tree = pstrdup(defGetString(def));
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
+					 errmsg("invalid type \"%s\" of branch %s in schema file \"%s\"",
+							type, branch, path)));
 		}
-		else if (strcmp(def->defname, "collection") == 0)
+
+		foreach(lc, tables)
 		{
-			collection = defGetString(def);
-			*is_collection = true;
+			RootImportTable *t = (RootImportTable *) lfirst(lc);
+
+			if (strcmp(t->tree, name) == 0 &&
+				(collection == NULL ? t->collection == NULL :
+				 t->collection != NULL && strcmp(t->collection, collection) == 0))
+			{
+				table = t;
+				break;
+			}
 		}
-		else if (strcmp(def->defname, "nattrs") == 0)
+		if (table == NULL)
 		{
-			nattrs = strtod(defGetString(def), NULL);
+			table = (RootImportTable *) palloc0(sizeof(RootImportTable));
+			table->tree = pstrdup(name);
+			table->collection = collection ? pstrdup(collection) : NULL;
+			tables = lappend(tables, table);
 		}
-		else if (strncmp(def->defname, "attr_", 5) == 0)
-		{
-			char *attname;
-			char *atttype;
-			char *saveptr;
 
-			attname = strtok_r(defGetString(def), ":", &saveptr);
-			if (attname == NULL)
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-						 errmsg("invalid attribute name for option %s in root_fdw", def->defname)));
-			}
+		table->attrs = lappend(table->attrs, attr);
+		table->typenames = lappend(table->typenames, pstrdup(type));
+		if (flag != NULL)
+			table->sorted_by = attr->attname;
+	}
 
-			atttype = strtok_r(NULL, ":", &saveptr);
-			if (atttype == NULL)
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-						 errmsg("invalid attribute type for option %s in root_fdw", def->defname)));
-			}
+	FreeFile(f);
 
-			attr = (RootAttr *) palloc(sizeof(RootAttr));
-			attr->attname = pstrdup(attname);
-			attr->atttype = get_root_type(atttype);
-			if (attr->atttype == RootInvalidType)
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-						 errmsg("invalid attribute type for field %s in root_fdw", def->defname)));
-			}
+	return tables;
+}
 
-			*schema = lappend(*schema, attr);
-		}
-	}
+/*
+ * Compare the tables read from the schema files of two shards.  Returns
+ * NULL if they are the same, or else a description of the first difference.
+ */
+static char *
+compare_shard_schemas(List *tables, List *other)
+{
+	ListCell   *lc;
+	ListCell   *lc2;
 
-	/* Add tree data type to schema */
-	attr = (RootAttr *) palloc(sizeof(RootAttr));
+	forboth(lc, tables, lc2, other)
+	{
+		RootImportTable *a = (RootImportTable *) lfirst(lc);
+		RootImportTable *b = (RootImportTable *) lfirst(lc2);
+		char	   *name;
+		ListCell   *lc3;
+		ListCell   *lc4;
 
-	attr->attname = (char *) palloc(strlen(*tree) + 4);
-	sprintf(attr->attname, "%s_id", *tree);
-	attr->atttype = RootTreeId;
+		if (a->collection)
+			name = psprintf("%s.%s", a->tree, a->collection);
+		else
+			name = a->tree;
 
-	*schema = lappend(*schema, attr);
+		if (strcmp(a->tree, b->tree) != 0 ||
+			(a->collection == NULL) != (b->collection == NULL) ||
+			(a->collection && strcmp(a->collection, b->collection) != 0))
+			return psprintf("Tree \"%s\" is not at the same place in both schemas.",
+							name);
 
-	/* Add collection data type to schema */
-	if (*is_collection)
-	{
-		attr = (RootAttr *) palloc(sizeof(RootAttr));
-		attr->attname = (char *) palloc(strlen(collection) + 4);
-		sprintf(attr->attname, "%s_id", collection);
-		attr->atttype = RootCollectionId;
+		if (list_length(a->attrs) != list_length(b->attrs))
+			return psprintf("Tree \"%s\" has %d branches in one schema and %d in the other.",
+							name, list_length(a->attrs), list_length(b->attrs));
 
-		*schema = lappend(*schema, attr);
-	}
+		forboth(lc3, a->attrs, lc4, b->attrs)
+		{
+			RootAttr   *attra = (RootAttr *) lfirst(lc3);
+			RootAttr   *attrb = (RootAttr *) lfirst(lc4);
 
-	/* Run-time validation of shard */
-	if (*shard < 0 || *shard >= MAXSHARDS)
-	{
-		ereport(ERROR,
-				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-				 errmsg("'shard' option refers to an unknown shard in root_fdw")));
-	}
+			if (strcmp(attra->attname, attrb->attname) != 0 ||
+				attra->atttype != attrb->atttype ||
+				attra->isarray != attrb->isarray)
+				return psprintf("Branch \"%s\" of tree \"%s\" differs.",
+								attra->attname, name);
+		}
 
-	/* Run-time validation of number of attributes */
-	if (nattrs < 0)
-	{
-		ereport(ERROR,
-				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-				 errmsg("'nattrs' option contains an invalid number of attributes in root_fdw")));
-	}
-	len = (*is_collection) ? nattrs + 2 : nattrs + 1;
-	if (list_length(*schema) != len)
-	{
-		ereport(ERROR,
-				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-				 errmsg("mismatch between 'nattrs' option and attributes specified as options in root_fdw")));
+		if ((a->sorted_by == NULL) != (b->sorted_by == NULL) ||
+			(a->sorted_by && strcmp(a->sorted_by, b->sorted_by) != 0))
+			return psprintf("Tree \"%s\" is sorted differently.", name);
 	}
+
+	if (list_length(tables) != list_length(other))
+		return pstrdup("The schemas have different numbers of trees.");
+
+	return NULL;
 }
 
 /*
- * rootGetForeignRelSize
- *		Obtain relation size estimates for a foreign table
+ * Parse the ROOT type of an attribute.  A type followed by "[]" declares an
+ * array of values of that type.
  */
-static void
-rootGetForeignRelSize(PlannerInfo *root,
-					  RelOptInfo *baserel,
-					  Oid foreigntableid)
+static RootAttributeType
+parse_root_type(char *name, bool *isarray)
 {
-	RootFdwPlanState   *fdw_private;
-	int					n;
-	char			  **fnames;
-	int					shard;
-	char			   *tree;
-	bool				is_collection;
-	List			   *schema;
+	size_t		len = strlen(name);
 
-	/* Fetch options */
-	rootGetOptions(foreigntableid, &shard, &tree, &schema, &is_collection);
+	*isarray = (len > 2 && strcmp(name + len - 2, "[]") == 0);
+	if (*isarray)
+		return get_root_type(pnstrdup(name, len - 2));
 
-	/* Get shard contents */
-	fnames = get_shard_contents(shard, &n);
+	return get_root_type(name);
+}
+
+/*
+ * Get shard information, reading the shard catalog the first time the shard
+ * is used by this backend.
+ */
+static RootShard *
+get_root_shard(int shard)
+{
+	RootShard	   *rshard;
+	MemoryContext	cxt;
+	MemoryContext	oldcxt;
+	char		  **fnames;
+	RootFile	   *files;
+	int				nfiles;
+	time_t			mtime;
+	char			path[MAXPGPATH];
+	struct stat		st;
+	bool			found;
+	int				i;
+
+	if (root_shards == NULL)
+	{
+		HASHCTL		ctl;
 
-	/* Initialize ROOT object */
-	if (!root_shard[shard])
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(int);
+		ctl.entrysize = sizeof(RootShard);
+		ctl.hcxt = TopMemoryContext;
+		root_shards = hash_create("root_fdw shards", 64, &ctl,
+								  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	/*
+	 * A shard already read is kept as long as its catalog doesn't change,
+	 * which is checked at most every ROOT_SHARD_CHECK_INTERVAL.  Files of a
+	 * changed shard that are being scanned must stay open, so the catalog is
+	 * only read again once no scan uses them.
+	 */
+	rshard = (RootShard *) hash_search(root_shards, &shard, HASH_FIND, NULL);
+	if (rshard)
 	{
-		root_shard[shard] = init_root(fnames, n);
-		if (!root_shard[shard])
+		TimestampTz now = GetCurrentTimestamp();
+
+		if (!TimestampDifferenceExceeds(rshard->checked, now,
+										ROOT_SHARD_CHECK_INTERVAL))
+			return rshard;
+		rshard->checked = now;
+
+		shard_file_path(path, shard, "files");
+		if (stat(path, &st) != 0 || st.st_mtime == rshard->mtime)
+			return rshard;
+
+		for (i = 0; i < rshard->nfiles; i++)
 		{
-			elog(ERROR, "failed to initialize ROOT's shard %d", shard);
+			if (rshard->files[i]->pins > 0)
+				return rshard;
 		}
 	}
 
-	/* Build fdw_private */
-	fdw_private = (RootFdwPlanState *) palloc(sizeof(RootFdwPlanState));
-	fdw_private->shard = shard;
-	fdw_private->tree = tree;
-	fdw_private->schema = schema;
-	fdw_private->is_collection = is_collection;
-	fdw_private->root_table = get_root_table(root_shard[shard], tree, is_collection);
-	if (!fdw_private->root_table)
+	/*
+	 * Shard information is kept for the lifetime of the backend, each
+	 * generation in a context of its own.  The catalog is read before the
+	 * shard is entered, and the context only moves under TopMemoryContext
+	 * then, so that a failure to read it leaves nothing behind.
+	 */
+	cxt = AllocSetContextCreate(CurrentMemoryContext,
+								"root_fdw shard",
+								ALLOCSET_SMALL_SIZES);
+	oldcxt = MemoryContextSwitchTo(cxt);
+
+	fnames = get_shard_contents(shard, &nfiles, &mtime);
+
+	files = (RootFile *) palloc0(Max(nfiles, 1) * sizeof(RootFile));
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextSetParent(cxt, TopMemoryContext);
+
+	rshard = (RootShard *) hash_search(root_shards, &shard, HASH_ENTER,
+									   &found);
+	if (found)
 	{
-		ereport(ERROR,
-				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-				 errmsg("'name' option refers to an unknown table in root_fdw")));
+		RootShard  *old;
+
+		/* Scans may still use the old files until the transaction ends */
+		close_shard_files(rshard);
+		old = (RootShard *) MemoryContextAlloc(rshard->cxt, sizeof(RootShard));
+		*old = *rshard;
+		oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+		root_shard_garbage = lappend(root_shard_garbage, old);
+		MemoryContextSwitchTo(oldcxt);
 	}
-	baserel->fdw_private = (void *) fdw_private;
+	else
+		rshard->generation = 0;
 
-	/* Estimate relation size */
-	estimate_size(root, baserel, fdw_private);
+	rshard->generation++;
+	rshard->mtime = mtime;
+	rshard->checked = GetCurrentTimestamp();
+	rshard->nfiles = nfiles;
+	rshard->fnames = fnames;
+	rshard->files = (RootFile **) MemoryContextAlloc(cxt, Max(nfiles, 1) *
+													 sizeof(RootFile *));
+	for (i = 0; i < nfiles; i++)
+		rshard->files[i] = &files[i];
+	rshard->cxt = cxt;
+
+	return rshard;
 }
 
 /*
- * rootGetForeignPaths
- *		Create possible access paths for a scan on the foreign table
- *
- *		Currently we don't support any push-down feature, so there is only one
- *		possible access path, which simply returns all records in the order in
- *		the data file.
+ * Get the files of the shards of a table, in a shard set allocated in the
+ * current memory context.  The files of a table spanning several shards are
+ * those of each shard, in the order of the shards.  The set keeps referring
+ * to the files it was built with if a shard is read again, until the end of
+ * the transaction.
  */
-static void
-rootGetForeignPaths(PlannerInfo *root,
-					RelOptInfo *baserel,
-					Oid foreigntableid)
+static RootShard *
+get_shard_set(List *shards)
 {
-	RootFdwPlanState *fdw_private = (RootFdwPlanState *) baserel->fdw_private;
-	Cost		startup_cost;
-	Cost		total_cost;
-	List	   *attrs;
-	List	   *private;
+	RootShard  *rshard;
+	ListCell   *lc;
+	int			nfiles = 0;
 
-	/* Collect attributes used by the query */
-	attrs = collect_attributes(baserel, fdw_private, foreigntableid);
+	if (list_length(shards) == 1)
+	{
+		rshard = (RootShard *) palloc(sizeof(RootShard));
+		*rshard = *get_root_shard(linitial_int(shards));
+		rshard->cxt = NULL;
+		return rshard;
+	}
 
-	/* Estimate costs */
-	estimate_costs(root, baserel, fdw_private,
-				   &startup_cost, &total_cost);
+	foreach(lc, shards)
+		nfiles += get_root_shard(lfirst_int(lc))->nfiles;
 
-	/* Build private list with root_table followed by attrs */
-	private = list_make2(fdw_private->root_table, attrs);
+	rshard = (RootShard *) palloc0(sizeof(RootShard));
+	rshard->shard = -1;
+	rshard->fnames = (char **) palloc(Max(nfiles, 1) * sizeof(char *));
+	rshard->files = (RootFile **) palloc(Max(nfiles, 1) * sizeof(RootFile *));
 
-	/*
-	 * Create a ForeignPath node and add it as only possible path.	We use the
-	 * fdw_private list of the path to carry the convert_selectively option;
-	 * it will be propagated into the fdw_private list of the Plan node.
-	 */
-	add_path(baserel, (Path *)
-			 create_foreignscan_path(root, baserel,
-									 baserel->rows,
-									 startup_cost,
-									 total_cost,
-									 NIL,		/* no pathkeys */
-									 NULL,		/* no outer rel either */
-									 private));
+	foreach(lc, shards)
+	{
+		RootShard  *part = get_root_shard(lfirst_int(lc));
 
-	/*
-	 * If data file was sorted, and we knew it somehow, we could insert
-	 * appropriate pathkeys into the ForeignPath node to tell the planner
-	 * that.
-	 */
+		memcpy(rshard->fnames + rshard->nfiles, part->fnames,
+			   part->nfiles * sizeof(char *));
+		memcpy(rshard->files + rshard->nfiles, part->files,
+			   part->nfiles * sizeof(RootFile *));
+		rshard->nfiles += part->nfiles;
+	}
+
+	return rshard;
 }
 
 /*
- * rootGetForeignPlan
- *		Create a ForeignScan plan node for scanning the foreign table
+ * Parse the value of the 'shards' option, a comma-separated list of shard
+ * numbers and ranges of shard numbers, as in "3,5,10-20", into an integer
+ * list without duplicates.  Lists of more than ROOT_MAX_SHARDS shards are
+ * rejected, as each shard of a table is read on every plan.
+ *
+ * Returns NIL if the value is malformed.
  */
-static ForeignScan *
-rootGetForeignPlan(PlannerInfo *root,
-				   RelOptInfo *baserel,
-				   Oid foreigntableid,
-				   ForeignPath *best_path,
-				   List *tlist,
-				   List *scan_clauses)
+static List *
+parse_shard_list(const char *value)
 {
-	Index		scan_relid = baserel->relid;
+	List	   *shards = NIL;
+	HTAB	   *seen;
+	HASHCTL		ctl;
+	int			nshards = 0;
+	const char *p = value;
 
-	/*
-	 * We have no native ability to evaluate restriction clauses, so we just
-	 * put all the scan_clauses into the plan node's qual list for the
-	 * executor to check.  So all we have to do here is strip RestrictInfo
-	 * nodes from the clauses and ignore pseudoconstants (which will be
-	 * handled elsewhere).
-	 */
-	scan_clauses = extract_actual_clauses(scan_clauses, false);
+	/* Shard numbers already listed, so that duplicates are found quickly */
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(int);
+	ctl.entrysize = sizeof(int);
+	ctl.hcxt = CurrentMemoryContext;
+	seen = hash_create("root_fdw shard list", 64, &ctl,
+					   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
 
-	/* Create the ForeignScan node */
-	return make_foreignscan(tlist,
-							scan_clauses,
-							scan_relid,
-							NIL,	/* no expressions to evaluate */
-							best_path->fdw_private);
-}
+	for (;;)
+	{
+		char	   *end;
+		long		lo;
+		long		hi;
+		long		n;
 
-/*
- * rootBeginForeignScan
- *		Initiate access to the file by creating CopyState
+		while (isspace((unsigned char) *p))
+			p++;
+		if (!isdigit((unsigned char) *p))
+		{
+			list_free(shards);
+			hash_destroy(seen);
+			return NIL;
+		}
+		lo = strtol(p, &end, 10);
+		p = end;
+		while (isspace((unsigned char) *p))
+			p++;
+
+		hi = lo;
+		if (*p == '-')
+		{
+			p++;
+			while (isspace((unsigned char) *p))
+				p++;
+			if (!isdigit((unsigned char) *p))
+			{
+				list_free(shards);
+				hash_destroy(seen);
+				return NIL;
+			}
+			hi = strtol(p, &end, 10);
+			p = end;
+			while (isspace((unsigned char) *p))
+				p++;
+		}
+
+		if (lo > hi || hi > INT_MAX)
+		{
+			list_free(shards);
+			hash_destroy(seen);
+			return NIL;
+		}
+
+		/* Check the width of ranges first, so that huge ones fail fast */
+		if (hi - lo >= ROOT_MAX_SHARDS)
+			nshards = ROOT_MAX_SHARDS + 1;
+
+		for (n = lo; n <= hi && nshards <= ROOT_MAX_SHARDS; n++)
+		{
+			int			shard = (int) n;
+			bool		found;
+
+			(void) hash_search(seen, &shard, HASH_ENTER, &found);
+			if (found)
+				continue;
+			shards = lappend_int(shards, shard);
+			nshards++;
+		}
+
+		if (nshards > ROOT_MAX_SHARDS)
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_INVALID_OPTION_VALUE),
+					 errmsg("too many shards in shard list \"%s\"", value),
+					 errdetail("A table can span at most %d shards.",
+							   ROOT_MAX_SHARDS)));
+
+		if (*p == '\0')
+			break;
+		if (*p != ',')
+		{
+			list_free(shards);
+			hash_destroy(seen);
+			return NIL;
+		}
+		p++;
+	}
+
+	hash_destroy(seen);
+
+	return shards;
+}
+
+/*
+ * Get ROOT table from a single file of a shard, initializing the ROOT object
+ * for that file if needed.
  */
-static void
-rootBeginForeignScan(ForeignScanState *node, int eflags)
+static RootTable *
+get_file_table(RootShard *rshard, int file, const char *tree,
+			   bool is_collection)
 {
-	ForeignScan *plan = (ForeignScan *) node->ss.ps.plan;
-	RootTable			   *root_table;
-	RootCursor			   *root_cursor;
-	RootFdwExecutionState  *festate;
-	ListCell   			   *lc;
-	List				   *attrs;
-	int						nattrs;
-	int					   *pos;
-	int						i = 0;
+	RootFile	   *rfile = rshard->files[file];
+	RootTable	   *root_table;
+	struct stat		st;
+	bool			have_stat;
 
-	/* First element from private list is root_table */
-	root_table = (RootTable *) list_nth(plan->fdw_private, 0);
-	attrs = (List *) list_nth(plan->fdw_private, 1);
-
-	/* Create ROOT cursor */
-	nattrs = list_length(attrs);
-	root_cursor	= init_root_cursor(root_table, nattrs);
-	if (!root_cursor)
+	/*
+	 * A file rewritten since its ROOT object was made has other entries, so
+	 * the object is made again, unless cursors are still open on it.
+	 */
+	have_stat = (stat(rshard->fnames[file], &st) == 0);
+	if (rfile->root && rfile->pins == 0 && have_stat &&
+		(st.st_mtime != rfile->mtime || st.st_size != rfile->size))
 	{
-		elog(ERROR, "failed to initialize ROOT's cursor");
+		dlist_delete(&rfile->lru_node);
+		fini_root(rfile->root);
+		rfile->root = NULL;
+		root_nopen--;
 	}
 
-	/* Add attributes to cursor */
-	pos = (int *) palloc(nattrs * sizeof(int));
-	foreach(lc, attrs)
+	/* Initialize ROOT object, making room for it first */
+	if (!rfile->root)
 	{
-		QueryAttr *attr = (QueryAttr *) lfirst(lc);
+		evict_file_roots(RootMaxOpenFiles - 1);
 
-		pos[i] = attr->pos;
-		if (!set_root_cursor_attr(root_cursor, i,
-								  attr->attr->attname, attr->attr->atttype))
+		rfile->root = init_root(&rshard->fnames[file], 1);
+		if (!rfile->root)
 		{
-			elog(ERROR, "failed to add attribute to ROOT cursor");
+			elog(ERROR, "failed to initialize ROOT file \"%s\"",
+				 rshard->fnames[file]);
 		}
-		i++;
+		dlist_push_head(&root_lru, &rfile->lru_node);
+		root_nopen++;
+		rfile->mtime = have_stat ? st.st_mtime : 0;
+		rfile->size = have_stat ? st.st_size : 0;
 	}
+	else
+		dlist_move_head(&root_lru, &rfile->lru_node);
 
-	/* Open ROOT cursor */
-	if (!open_root_cursor(root_cursor))
+	root_table = get_root_table(rfile->root, (char *) tree,
+								is_collection);
+	if (!root_table)
 	{
-		elog(ERROR, "failed to open ROOT cursor");
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+				 errmsg("'name' option refers to an unknown table in root_fdw")));
 	}
 
-	/* Save state in node->fdw_state */
-	festate = (RootFdwExecutionState *) palloc(sizeof(RootFdwExecutionState));
-	festate->root_cursor = root_cursor;
-	festate->pos = pos;
-	festate->nattrs = nattrs;
-	node->fdw_state = (void *) festate;
+	return root_table;
 }
 
 /*
- * rootIterateForeignScan
- *		Read next record from the data file and store it into the
- *		ScanTupleSlot as a virtual tuple
+ * Close least recently used ROOT instances until at most nopen are open.
+ * Instances with cursors open on them are kept.
  */
-static TupleTableSlot *
-rootIterateForeignScan(ForeignScanState *node)
+static void
+evict_file_roots(int nopen)
 {
-	RootFdwExecutionState  *festate = (RootFdwExecutionState *) node->fdw_state;
-	TupleTableSlot 		   *slot = node->ss.ss_ScanTupleSlot;
-	Datum				   *values = slot->tts_values;
-	bool				   *nulls = slot->tts_isnull;
-	RootCursor			   *root_cursor = festate->root_cursor;
-	int					   *pos = festate->pos;
-	int						nattrs = festate->nattrs;
-	int 					i = 0;
+	dlist_node *cur;
 
-	/*
-	 * The protocol for loading a virtual tuple into a slot is first
-	 * ExecClearTuple, then fill the values/isnull arrays, then
-	 * ExecStoreVirtualTuple.  If we don't find another row in the file, we
-	 * just skip the last step, leaving the slot empty as required.
-	 *
-	 * We can pass ExprContext = NULL because we read all columns from the
-	 * file, so no need to evaluate default expressions.
-	 *
-	 * We can also pass tupleOid = NULL because we don't allow oids for
-	 * foreign tables.
-	 */
-	ExecClearTuple(slot);
+	if (dlist_is_empty(&root_lru))
+		return;
 
-	if (advance_root_cursor(root_cursor))
+	cur = dlist_tail_node(&root_lru);
+	while (cur != NULL && root_nopen > nopen)
 	{
-		/* Initialize all values for this row to null */
-		//memset(values, 0, nattrs * sizeof(Datum));
-		//memset(nulls, true, nattrs * sizeof(bool));
+		RootFile   *rfile = dlist_container(RootFile, lru_node, cur);
+		dlist_node *prev;
 
-		/* Save values to tuple */
-		for (i = 0; i < nattrs; i++)
-		{
-			int p = pos[i];
-			nulls[p] = false;
+		prev = dlist_has_prev(&root_lru, cur) ?
+			dlist_prev_node(&root_lru, cur) : NULL;
 
-			switch (get_root_cursor_attr_type(root_cursor, i))
-			{
-			case RootTreeId:
-				values[p] = Int64GetDatum(get_tree_id(root_cursor, i));
-				break;
-			case RootCollectionId:
-				values[p] = Int32GetDatum(get_collection_id(root_cursor, i));
-				break;
-			case RootInt:
-				values[p] = Int32GetDatum(get_int(root_cursor, i));
-				break;
-			case RootUInt:
-				values[p] = UInt32GetDatum(get_uint(root_cursor, i));
-				break;
-			case RootFloat:
-				values[p] = Float8GetDatum(get_float(root_cursor, i));
-				break;
-			case RootBool:
-				values[p] = BoolGetDatum(get_bool(root_cursor, i));
-				break;
-			default:
-				elog(ERROR, "ROOT invalid type found");
-				break;
-			}
+		if (rfile->pins == 0)
+		{
+			dlist_delete(&rfile->lru_node);
+			fini_root(rfile->root);
+			rfile->root = NULL;
+			root_nopen--;
 		}
-		ExecStoreVirtualTuple(slot);
-	}
 
-	return slot;
+		cur = prev;
+	}
 }
 
 /*
- * rootReScanForeignScan
- *		Rescan table, possibly with new parameters
+ * Close the ROOT instances of all files of a shard.
  */
 static void
-rootReScanForeignScan(ForeignScanState *node)
+close_shard_files(RootShard *rshard)
 {
-	//RootFdwExecutionState *festate = (RootFdwExecutionState *) node->fdw_state;
-	// FIXME: Not implemented.
+	int			i;
+
+	for (i = 0; i < rshard->nfiles; i++)
+	{
+		RootFile   *rfile = rshard->files[i];
+
+		if (rfile->root)
+		{
+			dlist_delete(&rfile->lru_node);
+			fini_root(rfile->root);
+			rfile->root = NULL;
+			root_nopen--;
+		}
+	}
 }
 
 /*
- * rootEndForeignScan
- *		Finish scanning foreign table and dispose objects used for this scan
+ * Transaction callback.  Plan cache entries rebuilt and generations of shards
+ * replaced during the transaction are freed, and on abort the pins of all
+ * ROOT instances are released: cursors of scans that were in progress are
+ * abandoned, so they don't keep their files from being closed.
  */
 static void
-rootEndForeignScan(ForeignScanState *node)
+root_xact_callback(XactEvent event, void *arg)
 {
-	RootFdwExecutionState *festate = (RootFdwExecutionState *) node->fdw_state;
-	fini_root_cursor(festate->root_cursor);
+	dlist_iter	iter;
+	ListCell   *lc;
+
+	switch (event)
+	{
+	case XACT_EVENT_COMMIT:
+	case XACT_EVENT_PARALLEL_COMMIT:
+	case XACT_EVENT_PREPARE:
+		break;
+	case XACT_EVENT_ABORT:
+	case XACT_EVENT_PARALLEL_ABORT:
+		dlist_foreach(iter, &root_lru)
+		{
+			RootFile   *rfile = dlist_container(RootFile, lru_node, iter.cur);
+
+			rfile->pins = 0;
+		}
+		break;
+	default:
+		return;
+	}
+
+	foreach(lc, root_plan_cache_garbage)
+		MemoryContextDelete((MemoryContext) lfirst(lc));
+	list_free(root_plan_cache_garbage);
+	root_plan_cache_garbage = NIL;
+
+	/* Scans are over, so replaced generations of shards can go */
+	foreach(lc, root_shard_garbage)
+	{
+		RootShard  *old = (RootShard *) lfirst(lc);
+
+		close_shard_files(old);
+		MemoryContextDelete(old->cxt);
+	}
+	list_free(root_shard_garbage);
+	root_shard_garbage = NIL;
 }
 
 /*
- * Collect all attributes needed by query.
+ * Get number of entries of a ROOT table in a single file of a shard.
  *
- * The attributes collected are those needed by joins, final output or used by
- * restriction clauses.
+ * The shared metadata cache is consulted first, if available, so that the
+ * file is only opened by the first backend that needs it.
  */
-static List
-*collect_attributes(RelOptInfo *baserel, RootFdwPlanState *fdw_private,
-					Oid foreigntableid)
+static int64
+get_file_entries(RootShard *rshard, int file, const char *tree,
+				 bool is_collection)
 {
-	bool		has_wholerow = false;
-	ListCell   *lc;
-	Bitmapset  *attrs_used = NULL;
-	Relation	rel;
-	TupleDesc	tupdesc;
-	List	   *attrs = NIL;
-	int			i;
-	QueryAttr	*qattr;
-
-	/* Collect all the attributes needed for joins or final output. */
-	pull_varattnos((Node *) baserel->reltargetlist, baserel->relid,
-				   &attrs_used);
+	const char	   *fname = rshard->fnames[file];
+	RootFileMetaKey key;
+	RootFileMeta   *meta;
+	struct stat		st;
+	bool			found;
+	int64			entries;
 
-	/* Add all the attributes used by restriction clauses. */
-	foreach(lc, baserel->baserestrictinfo)
+	if (!root_metadata ||
+		strlen(fname) >= MAXPGPATH || strlen(tree) >= NAMEDATALEN ||
+		stat(fname, &st) != 0)
 	{
-		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		return get_root_table_approx_size(get_file_table(rshard, file, tree,
+														 is_collection));
+	}
 
-		pull_varattnos((Node *) rinfo->clause, baserel->relid,
-					   &attrs_used);
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.fname, fname, MAXPGPATH);
+	strlcpy(key.tree, tree, NAMEDATALEN);
+	key.is_collection = is_collection;
+
+	LWLockAcquire(root_shared->lock, LW_SHARED);
+	meta = (RootFileMeta *) hash_search(root_metadata, &key, HASH_FIND, NULL);
+	if (meta && meta->mtime == st.st_mtime && meta->size == st.st_size)
+	{
+		entries = meta->entries;
+		LWLockRelease(root_shared->lock);
+		return entries;
 	}
+	LWLockRelease(root_shared->lock);
 
-	/* If there's a whole-row reference, we'll need all the columns. */
-	has_wholerow = bms_is_member(0 - FirstLowInvalidHeapAttributeNumber,
-								 attrs_used);
+	/* Not cached, or file changed: read it from ROOT */
+	entries = get_root_table_approx_size(get_file_table(rshard, file, tree,
+														is_collection));
 
-	/* Build List with attribute numbers. */
-	rel = heap_open(foreigntableid, AccessShareLock);
-	tupdesc = RelationGetDescr(rel);
-	for (i = 1; i <= tupdesc->natts; i++)
+	/* If the cache is full, just don't remember it */
+	LWLockAcquire(root_shared->lock, LW_EXCLUSIVE);
+	meta = (RootFileMeta *) hash_search(root_metadata, &key,
+										HASH_ENTER_NULL, &found);
+	if (meta)
 	{
-		Form_pg_attribute attr = tupdesc->attrs[i - 1];
+		meta->mtime = st.st_mtime;
+		meta->size = st.st_size;
+		meta->entries = entries;
+	}
+	LWLockRelease(root_shared->lock);
 
-		/* Ignore dropped attributes. */
-		if (attr->attisdropped)
-			continue;
+	return entries;
+}
 
-		if (has_wholerow ||
-			bms_is_member(i - FirstLowInvalidHeapAttributeNumber,
-						  attrs_used))
-		{
-			qattr = NULL;
-			/*
-			 * Find requested attribute in the set of attributes given as
-			 * options in the table.
-			 */
-			foreach(lc, fdw_private->schema)
-			{
-				RootAttr *rattr = (RootAttr *) lfirst(lc);
+/*
+ * Build the key of a chunk of a branch in the column cache.  Tables may
+ * declare a branch with different types, so the type the values are read as
+ * is part of the key.
+ *
+ * Returns false if the names are too long to be cached.
+ */
+static bool
+make_column_key(RootColumnKey *key, const char *fname, const char *tree,
+				bool is_collection, const char *branch,
+				RootAttributeType atttype, int chunk)
+{
+	if (strlen(fname) >= MAXPGPATH || strlen(tree) >= NAMEDATALEN ||
+		strlen(branch) >= NAMEDATALEN)
+		return false;
 
-				if (strcasecmp(rattr->attname, attr->attname.data) == 0)
-				{
-					qattr = (QueryAttr *) palloc(sizeof(QueryAttr));
-					qattr->attr = rattr;
-					qattr->pos = attr->attnum - 1;
-					break;
-				}
-			}
+	memset(key, 0, sizeof(*key));
+	strlcpy(key->file.fname, fname, MAXPGPATH);
+	strlcpy(key->file.tree, tree, NAMEDATALEN);
+	key->file.is_collection = is_collection;
+	strlcpy(key->branch, branch, NAMEDATALEN);
+	key->atttype = (int32) atttype;
+	key->chunk = chunk;
 
-			if (qattr == NULL)
-			{
-				elog(ERROR,
-					"Failed to retrieve ROOT attribute %s in ROOT schema",
-					attr->attname.data);
-			}
-			attrs = lappend(attrs, qattr);
-		}
+	return true;
+}
+
+/*
+ * Copy the values of a chunk from the column cache, if it holds the chunk
+ * for the current version of the file.
+ *
+ * Returns the number of values, or -1 if the chunk is not cached.
+ */
+static int
+get_cached_chunk(RootColumnKey *key, struct stat *st,
+				 RootCacheValue *values, bool *last)
+{
+	RootColumnChunk *chunk;
+	int				nvalues = -1;
+
+	LWLockAcquire(root_shared->column_lock, LW_SHARED);
+	chunk = (RootColumnChunk *) hash_search(root_column_cache, key,
+											HASH_FIND, NULL);
+	if (chunk && chunk->mtime == st->st_mtime && chunk->size == st->st_size)
+	{
+		RootCacheBlock *block = &root_cache_blocks[chunk->block];
+
+		memcpy(values, root_cache_data + (Size) chunk->block * ROOT_CACHE_CHUNK,
+			   chunk->nvalues * sizeof(RootCacheValue));
+		nvalues = chunk->nvalues;
+		*last = chunk->last;
+
+		/* Racing increments under the shared lock only lose some usage */
+		if (block->usage < ROOT_CACHE_MAX_USAGE)
+			block->usage++;
 	}
-	heap_close(rel, AccessShareLock);
+	LWLockRelease(root_shared->column_lock);
 
-	return attrs;
+	return nvalues;
 }
 
 /*
- * Estimate size of a foreign table.
- *
- * The main result is returned in baserel->rows.  We also set
- * fdw_private->pages and fdw_private->ntuples for later use in the cost
- * calculation.
+ * Store the values of a chunk in the column cache.  A block is taken by the
+ * clock sweep, evicting the chunk it held if it wasn't used lately; a chunk
+ * of an older version of the file reuses its block.  If no block can be
+ * found, the chunk is just not remembered.
  */
 static void
-estimate_size(PlannerInfo *root, RelOptInfo *baserel,
-			  RootFdwPlanState *fdw_private)
+put_cached_chunk(RootColumnKey *key, struct stat *st,
+				 RootCacheValue *values, int nvalues, bool last)
 {
-	BlockNumber pages;
-	double		ntuples;
-	double		nrows;
-	double		fsize;
+	RootColumnChunk *chunk;
+	RootCacheBlock *block = NULL;
+	bool			found;
+	int				b = -1;
+	int				i;
 
-	/* Get size estimate from ROOT. */
-	ntuples = get_root_table_approx_size(fdw_private->root_table);
-	fdw_private->ntuples = ntuples;
+	LWLockAcquire(root_shared->column_lock, LW_EXCLUSIVE);
 
-	/*
-	 * Convert the number of tuples to an estimate of the I/O cost.
-	 * Needless to say, this is completely bogus!
-	 */
-	fsize = ntuples * 100;
-	pages = (fsize + (BLCKSZ - 1)) / BLCKSZ;
-	if (pages < 1)
-		pages = 1;
-	fdw_private->pages = pages;
+	chunk = (RootColumnChunk *) hash_search(root_column_cache, key,
+											HASH_FIND, NULL);
+	if (chunk)
+	{
+		/* Another scan of the same file may have stored it already */
+		if (chunk->mtime == st->st_mtime && chunk->size == st->st_size)
+		{
+			LWLockRelease(root_shared->column_lock);
+			return;
+		}
+		b = chunk->block;
+		block = &root_cache_blocks[b];
+	}
+	else
+	{
+		for (i = 0; i < root_cache_nblocks * (ROOT_CACHE_MAX_USAGE + 1); i++)
+		{
+			RootCacheBlock *candidate;
 
-	/*
-	 * Now estimate the number of rows returned by the scan after applying the
-	 * baserestrictinfo quals.
-	 */
-	nrows = ntuples *
-		clauselist_selectivity(root,
-							   baserel->baserestrictinfo,
-							   0,
-							   JOIN_INNER,
-							   NULL);
+			candidate = &root_cache_blocks[root_shared->clock_hand];
+			if (!candidate->used || candidate->usage == 0)
+			{
+				b = root_shared->clock_hand;
+				block = candidate;
+			}
+			else
+				candidate->usage--;
 
-	nrows = clamp_row_est(nrows);
+			root_shared->clock_hand = (root_shared->clock_hand + 1) %
+				root_cache_nblocks;
+			if (block)
+				break;
+		}
 
-	/* Save the output-rows estimate for the planner */
-	baserel->rows = nrows;
+		if (block == NULL)
+		{
+			LWLockRelease(root_shared->column_lock);
+			return;
+		}
+
+		if (block->used)
+		{
+			hash_search(root_column_cache, &block->key, HASH_REMOVE, NULL);
+			block->used = false;
+		}
+
+		chunk = (RootColumnChunk *) hash_search(root_column_cache, key,
+												HASH_ENTER_NULL, &found);
+		if (chunk == NULL)
+		{
+			LWLockRelease(root_shared->column_lock);
+			return;
+		}
+		chunk->block = b;
+		block->key = *key;
+		block->used = true;
+	}
+
+	chunk->mtime = st->st_mtime;
+	chunk->size = st->st_size;
+	chunk->nvalues = nvalues;
+	chunk->last = last;
+	block->usage = 1;
+	memcpy(root_cache_data + (Size) b * ROOT_CACHE_CHUNK, values,
+		   nvalues * sizeof(RootCacheValue));
+
+	LWLockRelease(root_shared->column_lock);
 }
 
 /*
- * Estimate costs of scanning a foreign table.
- *
- * Results are returned in *startup_cost and *total_cost.
+ * Fetch the options for a root_fdw foreign table.
  */
 static void
-estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
-			   RootFdwPlanState *fdw_private,
-			   Cost *startup_cost, Cost *total_cost)
+rootGetOptions(Oid foreigntableid,
+			   List **shards, char **tree,
+			   List **schema, bool *is_collection,
+			   bool *readahead, char **sorted_by)
 {
-	BlockNumber pages = fdw_private->pages;
-	double		ntuples = fdw_private->ntuples;
-	Cost		run_cost = 0;
-	Cost		cpu_per_tuple;
+	ForeignTable 	   *table;
+	ForeignServer 	   *server;
+	ForeignDataWrapper *wrapper;
+	List	   		   *options;
+	ListCell   		   *cell;
+	char			   *collection = NULL;
+	int					nattrs = -1;
+	RootAttr		   *attr;
+	int					len;
 
 	/*
-	 * We estimate costs almost the same way as cost_seqscan(), thus assuming
-	 * that I/O costs are equivalent to a regular table file of the same size.
-	 * However, we take per-tuple CPU costs as 1.5x of a seqscan, to account
-	 * for the cost of moving data from ROOT to PostgreSQL tuples.
+	 * Default uninitialized values for options.
+	 */
+	*shards = NIL;
+	*tree = NULL;
+	*schema = NIL;
+	*is_collection = false;
+	*readahead = false;
+	*sorted_by = NULL;
+
+	/*
+	 * Extract options from FDW objects.  We ignore user mappings because
+	 * root_fdw doesn't have any options that can be specified there.
+	 *
+	 * (XXX Actually, given the current contents of valid_options[], there's
+	 * no point in examining anything except the foreign table's own options.
+	 * Simplify?)
+	 */
+	table = GetForeignTable(foreigntableid);
+	server = GetForeignServer(table->serverid);
+	wrapper = GetForeignDataWrapper(server->fdwid);
+
+	options = NIL;
+	options = list_concat(options, wrapper->options);
+	options = list_concat(options, server->options);
+	options = list_concat(options, table->options);
+
+	foreach(cell, options)
+	{
+		DefElem    *def = (DefElem *) lfirst(cell);
+
+		if (strcmp(def->defname, "shard") == 0)
+		{
+			*shards = list_make1_int((int) strtod(defGetString(def), NULL));
+		}
+		else if (strcmp(def->defname, "shards") == 0)
+		{
+			/* Table's shards take precedence over server's shard */
+			*shards = parse_shard_list(defGetString(def));
+		}
+		else if (strcmp(def->defname, "tree") == 0)
+		{
+			*tree = pstrdup(defGetString(def));
+		}
+		else if (strcmp(def->defname, "collection") == 0)
+		{
+			collection = defGetString(def);
+			*is_collection = true;
+		}
+		else if (strcmp(def->defname, "nattrs") == 0)
+		{
+			nattrs = strtod(defGetString(def), NULL);
+		}
+		else if (strcmp(def->defname, "io_mode") == 0)
+		{
+			/* Table option takes precedence over server option */
+			*readahead = (strcmp(defGetString(def), "readahead") == 0);
+		}
+		else if (strcmp(def->defname, "sorted_by") == 0)
+		{
+			*sorted_by = pstrdup(defGetString(def));
+		}
+		else if (strncmp(def->defname, "attr_", 5) == 0)
+		{
+			char *attname;
+			char *atttype;
+			char *saveptr;
+
+			attname = strtok_r(defGetString(def), ":", &saveptr);
+			if (attname == NULL)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+						 errmsg("invalid attribute name for option %s in root_fdw", def->defname)));
+			}
+
+			atttype = strtok_r(NULL, ":", &saveptr);
+			if (atttype == NULL)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+						 errmsg("invalid attribute type for option %s in root_fdw", def->defname)));
+			}
+
+			attr = (RootAttr *) palloc(sizeof(RootAttr));
+			attr->attname = pstrdup(attname);
+			attr->atttype = parse_root_type(atttype, &attr->isarray);
+			if (attr->atttype == RootInvalidType ||
+				(attr->isarray && (attr->atttype == RootTreeId ||
+								   attr->atttype == RootCollectionId)))
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+						 errmsg("invalid attribute type for field %s in root_fdw", def->defname)));
+			}
+
+			*schema = lappend(*schema, attr);
+		}
+	}
+
+	/* Add tree data type to schema */
+	attr = (RootAttr *) palloc(sizeof(RootAttr));
+
+	attr->attname = (char *) palloc(strlen(*tree) + 4);
+	sprintf(attr->attname, "%s_id", *tree);
+	attr->atttype = RootTreeId;
+	attr->isarray = false;
+
+	*schema = lappend(*schema, attr);
+
+	/* Add collection data type to schema */
+	if (*is_collection)
+	{
+		attr = (RootAttr *) palloc(sizeof(RootAttr));
+		attr->attname = (char *) palloc(strlen(collection) + 4);
+		sprintf(attr->attname, "%s_id", collection);
+		attr->atttype = RootCollectionId;
+		attr->isarray = false;
+
+		*schema = lappend(*schema, attr);
+	}
+
+	/* Run-time validation of shards */
+	if (*shards == NIL)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+				 errmsg("'shard' server option or 'shards' table option is required in root_fdw")));
+	}
+	foreach(cell, *shards)
+	{
+		if (lfirst_int(cell) < 0)
+		{
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+					 errmsg("'shard' option refers to an unknown shard in root_fdw")));
+		}
+	}
+
+	/* Run-time validation of number of attributes */
+	if (nattrs < 0)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+				 errmsg("'nattrs' option contains an invalid number of attributes in root_fdw")));
+	}
+	len = (*is_collection) ? nattrs + 2 : nattrs + 1;
+	if (list_length(*schema) != len)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+				 errmsg("mismatch between 'nattrs' option and attributes specified as options in root_fdw")));
+	}
+
+	/* Run-time validation of array attributes */
+	if (*is_collection)
+	{
+		foreach(cell, *schema)
+		{
+			if (((RootAttr *) lfirst(cell))->isarray)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+						 errmsg("array attributes can only be used in root_fdw tables of trees")));
+			}
+		}
+	}
+
+	/* Run-time validation of sort order */
+	if (*sorted_by != NULL)
+	{
+		attr = find_root_attr(*schema, *sorted_by);
+		if (attr == NULL || attr->isarray ||
+			attr->atttype == RootTreeId || attr->atttype == RootCollectionId)
+		{
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+					 errmsg("'sorted_by' option must refer to a branch of the table in root_fdw")));
+		}
+		*sorted_by = attr->attname;
+	}
+}
+
+/*
+ * Get planner information for a foreign table, from the plan cache if it
+ * is still valid.  The result is a copy the caller may modify, sharing the
+ * lists of the cache entry.
+ */
+static RootFdwPlanState *
+get_plan_state(Oid foreigntableid)
+{
+	RootPlanCacheEntry *entry;
+	RootFdwPlanState *fdw_private;
+	MemoryContext oldcxt;
+	ListCell   *lc;
+	bool		found;
+	int			i;
+
+	if (root_plan_cache == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(RootPlanCacheEntry);
+		ctl.hcxt = TopMemoryContext;
+		root_plan_cache = hash_create("root_fdw plan cache", 64, &ctl,
+									  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		CacheRegisterSyscacheCallback(FOREIGNTABLEREL,
+									  invalidate_plan_cache, (Datum) 0);
+		CacheRegisterSyscacheCallback(FOREIGNSERVEROID,
+									  invalidate_plan_cache, (Datum) 0);
+		CacheRegisterSyscacheCallback(FOREIGNDATAWRAPPEROID,
+									  invalidate_plan_cache, (Datum) 0);
+		CacheRegisterRelcacheCallback(invalidate_plan_cache_rel, (Datum) 0);
+	}
+
+	entry = (RootPlanCacheEntry *) hash_search(root_plan_cache,
+											   &foreigntableid, HASH_ENTER,
+											   &found);
+	if (!found)
+	{
+		entry->valid = false;
+		entry->cxt = NULL;
+	}
+
+	/* Shards whose catalog was read again have other files */
+	if (entry->valid)
+	{
+		i = 0;
+		foreach(lc, entry->state->shards)
+		{
+			if (get_root_shard(lfirst_int(lc))->generation !=
+				entry->generations[i++])
+			{
+				entry->valid = false;
+				break;
+			}
+		}
+	}
+
+	if (!entry->valid)
+	{
+		if (entry->cxt)
+		{
+			oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+			root_plan_cache_garbage = lappend(root_plan_cache_garbage,
+											  entry->cxt);
+			MemoryContextSwitchTo(oldcxt);
+		}
+		entry->cxt = AllocSetContextCreate(TopMemoryContext,
+										   "root_fdw plan cache entry",
+										   ALLOCSET_SMALL_SIZES);
+
+		oldcxt = MemoryContextSwitchTo(entry->cxt);
+		entry->state = build_plan_state(foreigntableid);
+		entry->generations = (int *) palloc(list_length(entry->state->shards) *
+											sizeof(int));
+		i = 0;
+		foreach(lc, entry->state->shards)
+			entry->generations[i++] = get_root_shard(lfirst_int(lc))->generation;
+		MemoryContextSwitchTo(oldcxt);
+
+		entry->valid = true;
+	}
+
+	fdw_private = (RootFdwPlanState *) palloc(sizeof(RootFdwPlanState));
+	memcpy(fdw_private, entry->state, sizeof(RootFdwPlanState));
+
+	return fdw_private;
+}
+
+/*
+ * Build planner information for a foreign table from its options and the
+ * contents of its shards.
+ */
+static RootFdwPlanState *
+build_plan_state(Oid foreigntableid)
+{
+	RootFdwPlanState   *fdw_private;
+	RootShard		   *rshard;
+	List			   *shards;
+	char			   *tree;
+	bool				is_collection;
+	bool				readahead;
+	char			   *sorted_by;
+	List			   *schema;
+	int64				entries = 0;
+	int					i;
+
+	/* Fetch options */
+	rootGetOptions(foreigntableid, &shards, &tree, &schema, &is_collection,
+				   &readahead, &sorted_by);
+
+	/* Get shard contents */
+	rshard = get_shard_set(shards);
+
+	/* Build fdw_private */
+	fdw_private = (RootFdwPlanState *) palloc0(sizeof(RootFdwPlanState));
+	fdw_private->shards = shards;
+	fdw_private->tree = tree;
+	fdw_private->schema = schema;
+	fdw_private->is_collection = is_collection;
+	fdw_private->readahead = readahead;
+	fdw_private->sorted_by = sorted_by;
+	fdw_private->nfiles = rshard->nfiles;
+
+	/*
+	 * Files are scanned independently, each with its own ROOT object, so the
+	 * tree ids of each file are offset by the number of tree entries in the
+	 * files before it.  This keeps tree ids unique across the shard.
+	 */
+	fdw_private->offsets = NIL;
+	for (i = 0; i < rshard->nfiles; i++)
+	{
+		fdw_private->offsets = lappend(fdw_private->offsets,
+									   makeInteger((long) entries));
+		entries += get_file_entries(rshard, i, tree, false);
+	}
+	fdw_private->offsets = lappend(fdw_private->offsets,
+								   makeInteger((long) entries));
+
+	/* Entries of the table itself, and size of the files, for estimates */
+	fdw_private->entries = (double *) palloc(Max(rshard->nfiles, 1) *
+											 sizeof(double));
+	for (i = 0; i < rshard->nfiles; i++)
+	{
+		fdw_private->entries[i] = get_file_entries(rshard, i, tree,
+												   is_collection);
+	}
+	fdw_private->bytes = get_shard_bytes(rshard);
+
+	resolve_columns(foreigntableid, fdw_private);
+
+	return fdw_private;
+}
+
+/*
+ * Syscache callback marking all plan cache entries invalid when options of
+ * a foreign table, server or wrapper change.
+ */
+static void
+invalidate_plan_cache(Datum arg, int cacheid, uint32 hashvalue)
+{
+	HASH_SEQ_STATUS status;
+	RootPlanCacheEntry *entry;
+
+	hash_seq_init(&status, root_plan_cache);
+	while ((entry = (RootPlanCacheEntry *) hash_seq_search(&status)) != NULL)
+		entry->valid = false;
+}
+
+/*
+ * Relcache callback marking the plan cache entry of a relation invalid, or
+ * all of them.
+ */
+static void
+invalidate_plan_cache_rel(Datum arg, Oid relid)
+{
+	RootPlanCacheEntry *entry;
+
+	if (relid == InvalidOid)
+	{
+		invalidate_plan_cache(arg, 0, 0);
+		return;
+	}
+
+	entry = (RootPlanCacheEntry *) hash_search(root_plan_cache, &relid,
+											   HASH_FIND, NULL);
+	if (entry)
+		entry->valid = false;
+}
+
+/*
+ * Build the private list of a ForeignScan plan node, with everything
+ * create_execution_state needs to open cursors on the files of the shard, in
+ * the order of FdwScanPrivateIndex.
+ */
+static List *
+build_scan_private(RootFdwPlanState *fdw_private, List *attrs,
+				   List *remote_exprs)
+{
+	List	   *private;
+
+	/* Planner information may come from the plan cache, so copy it */
+	private = list_make4(list_copy(fdw_private->shards),
+						 makeString(pstrdup(fdw_private->tree)),
+						 makeInteger(fdw_private->is_collection),
+						 attrs);
+	private = lappend(private, copyObject(fdw_private->offsets));
+	private = lappend(private, remote_exprs);
+	private = lappend(private, makeInteger(fdw_private->readahead));
+
+	return private;
+}
+
+/*
+ * Get total size in bytes of the files of a shard.
+ */
+static double
+get_shard_bytes(RootShard *rshard)
+{
+	double		bytes = 0;
+	int			i;
+
+	for (i = 0; i < rshard->nfiles; i++)
+	{
+		struct stat st;
+
+		if (stat(rshard->fnames[i], &st) == 0)
+			bytes += st.st_size;
+	}
+
+	return bytes;
+}
+
+/*
+ * Build the path of the zone map of a table of a shard.
+ */
+static void
+zone_map_path(char *path, int shard, const char *tree, bool is_collection)
+{
+	snprintf(path, MAXPGPATH, "%s/shard-%d.%s%s.zonemap", ShardPath, shard,
+			 tree, is_collection ? ".collection" : "");
+}
+
+/*
+ * Get the zone map of a table of a shard, loading it if it wasn't loaded
+ * yet or its file changed since.
+ *
+ * Each line of the file holds the zone of a branch in a file of the shard:
+ * the file name, its modification time and size when the zone map was
+ * built, the branch name and its smallest and greatest values, separated by
+ * tabs.  Returns NULL if there is no zone map.
+ */
+static RootZoneMap *
+get_zone_map(RootShard *rshard, int shard, const char *tree,
+			 bool is_collection)
+{
+	RootZoneMap *map;
+	char		path[MAXPGPATH];
+	char		buf[MAXPGPATH + 256];
+	struct stat st;
+	MemoryContext cxt;
+	MemoryContext oldcxt;
+	HASHCTL		ctl;
+	HTAB	   *names;
+	FILE	   *f;
+	ListCell   *lc;
+	int			i;
+
+	zone_map_path(path, shard, tree, is_collection);
+	if (stat(path, &st) != 0)
+		return NULL;
+
+	foreach(lc, root_zone_maps)
+	{
+		map = (RootZoneMap *) lfirst(lc);
+		if (strcmp(map->path, path) != 0)
+			continue;
+
+		if (map->mtime == st.st_mtime && map->nfiles == rshard->nfiles)
+			return map;
+
+		/* Zone map was rebuilt, or shard changed */
+		oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+		root_zone_maps = list_delete_ptr(root_zone_maps, map);
+		MemoryContextSwitchTo(oldcxt);
+		MemoryContextDelete(map->cxt);
+		break;
+	}
+
+	f = AllocateFile(path, "r");
+	if (!f)
+		return NULL;
+
+	cxt = AllocSetContextCreate(TopMemoryContext,
+								"root_fdw zone map",
+								ALLOCSET_DEFAULT_SIZES);
+	oldcxt = MemoryContextSwitchTo(cxt);
+
+	map = (RootZoneMap *) palloc0(sizeof(RootZoneMap));
+	strlcpy(map->path, path, MAXPGPATH);
+	map->mtime = st.st_mtime;
+	map->nfiles = rshard->nfiles;
+	map->files = (RootFileZones *) palloc0(Max(rshard->nfiles, 1) *
+										   sizeof(RootFileZones));
+	map->cxt = cxt;
+
+	/* Map file names to their index in the shard */
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = MAXPGPATH;
+	ctl.entrysize = sizeof(RootZoneFileEntry);
+	ctl.hcxt = cxt;
+	names = hash_create("root_fdw zone map files", Max(rshard->nfiles, 1),
+						&ctl, HASH_ELEM | HASH_CONTEXT);
+	for (i = 0; i < rshard->nfiles; i++)
+	{
+		char		key[MAXPGPATH];
+		RootZoneFileEntry *entry;
+
+		memset(key, 0, sizeof(key));
+		strlcpy(key, rshard->fnames[i], MAXPGPATH);
+		entry = (RootZoneFileEntry *) hash_search(names, key, HASH_ENTER,
+												  NULL);
+		entry->file = i;
+	}
+
+	while (fgets(buf, sizeof(buf), f) != NULL)
+	{
+		char	   *fields[6];
+		char	   *pos;
+		char		key[MAXPGPATH];
+		RootZoneFileEntry *entry;
+		RootFileZones *fz;
+		RootZone   *zone;
+		int			k;
+
+		if ((pos = strchr(buf, '\n')) != NULL)
+			*pos = '\0';
+
+		/* File names may contain tabs, so split fields from the end */
+		for (k = 5; k > 0; k--)
+		{
+			pos = strrchr(buf, '\t');
+			if (pos == NULL)
+				break;
+			*pos = '\0';
+			fields[k] = pos + 1;
+		}
+		if (k > 0)
+			continue;
+		fields[0] = buf;
+
+		memset(key, 0, sizeof(key));
+		strlcpy(key, fields[0], MAXPGPATH);
+		entry = (RootZoneFileEntry *) hash_search(names, key, HASH_FIND, NULL);
+		if (entry == NULL)
+			continue;
+
+		fz = &map->files[entry->file];
+		if (fz->nzones == 0)
+		{
+			fz->mtime = (time_t) strtol(fields[1], NULL, 10);
+			fz->size = (off_t) strtoll(fields[2], NULL, 10);
+			fz->zones = (RootZone *) palloc(sizeof(RootZone));
+		}
+		else
+		{
+			fz->zones = (RootZone *) repalloc(fz->zones, (fz->nzones + 1) *
+											  sizeof(RootZone));
+		}
+
+		zone = &fz->zones[fz->nzones++];
+		zone->branch = pstrdup(fields[3]);
+		zone->min = strtod(fields[4], NULL);
+		zone->max = strtod(fields[5], NULL);
+	}
+
+	FreeFile(f);
+	hash_destroy(names);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+	root_zone_maps = lappend(root_zone_maps, map);
+	MemoryContextSwitchTo(oldcxt);
+
+	return map;
+}
+
+/*
+ * Find files of the shards of a table that can be skipped, because their
+ * zone map shows they hold no value accepted by one of the conditions.
+ * branches[] holds the ROOT branch of each condition.  Zones of files
+ * modified since the zone map was built are ignored.  Files are numbered as
+ * in the shard set of the shards, so a whole shard is skipped when all its
+ * files are.
+ *
+ * Returns NULL if no shard of the table has a zone map.
+ */
+static bool *
+get_skipped_files(List *shards, const char *tree, bool is_collection,
+				  RootQual *quals, char **branches, int nquals)
+{
+	bool	   *skip = NULL;
+	ListCell   *lc;
+	int			nfiles = 0;
+	int			base = 0;
+
+	if (nquals == 0)
+		return NULL;
+
+	foreach(lc, shards)
+		nfiles += get_root_shard(lfirst_int(lc))->nfiles;
+
+	foreach(lc, shards)
+	{
+		int			shard = lfirst_int(lc);
+		RootShard  *rshard = get_root_shard(shard);
+		RootZoneMap *map;
+		int			i;
+
+		map = get_zone_map(rshard, shard, tree, is_collection);
+		if (map == NULL)
+		{
+			base += rshard->nfiles;
+			continue;
+		}
+
+		if (skip == NULL)
+			skip = (bool *) palloc0(Max(nfiles, 1) * sizeof(bool));
+
+		for (i = 0; i < rshard->nfiles; i++)
+		{
+			RootFileZones *fz = &map->files[i];
+			struct stat st;
+			int			q;
+
+			if (fz->nzones == 0 ||
+				stat(rshard->fnames[i], &st) != 0 ||
+				st.st_mtime != fz->mtime || st.st_size != fz->size)
+				continue;
+
+			for (q = 0; q < nquals && !skip[base + i]; q++)
+			{
+				int			z;
+
+				if (quals[q].atttype == RootTreeId ||
+					quals[q].atttype == RootCollectionId)
+					continue;
+
+				for (z = 0; z < fz->nzones; z++)
+				{
+					if (strcmp(fz->zones[z].branch, branches[q]) == 0)
+					{
+						skip[base + i] = zone_excludes(&fz->zones[z],
+													   &quals[q]);
+						break;
+					}
+				}
+			}
+		}
+
+		base += rshard->nfiles;
+	}
+
+	return skip;
+}
+
+/*
+ * Does a zone show that no value of its branch is accepted by a condition?
+ * Values are compared as float8 comparisons do, so NaNs are greatest.
+ */
+static bool
+zone_excludes(RootZone *zone, RootQual *qual)
+{
+	double		value = qual->isfloat ? qual->fval : (double) qual->ival;
+	int			cmp_min = root_float_cmp(value, zone->min);
+	int			cmp_max = root_float_cmp(value, zone->max);
+
+	switch (qual->strategy)
+	{
+	case BTLessStrategyNumber:
+		return cmp_min <= 0;
+	case BTLessEqualStrategyNumber:
+		return cmp_min < 0;
+	case BTEqualStrategyNumber:
+		return cmp_min < 0 || cmp_max > 0;
+	case BTGreaterEqualStrategyNumber:
+		return cmp_max > 0;
+	case BTGreaterStrategyNumber:
+		return cmp_max >= 0;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Get the value of a branch for the entry the cursor is positioned on, as
+ * a double.
+ */
+static double
+get_value_as_double(RootCursor *root_cursor, int attr,
+					RootAttributeType atttype)
+{
+	switch (atttype)
+	{
+	case RootInt:
+		return get_int(root_cursor, attr);
+	case RootUInt:
+		return get_uint(root_cursor, attr);
+	case RootFloat:
+		return get_float(root_cursor, attr);
+	case RootBool:
+		return get_bool(root_cursor, attr) ? 1 : 0;
+	default:
+		elog(ERROR, "ROOT invalid type found");
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Check that a relation is a foreign table of root_fdw.
+ */
+static void
+check_root_table(Oid relid)
+{
+	if (get_rel_relkind(relid) != RELKIND_FOREIGN_TABLE ||
+		GetFdwRoutineByRelId(relid)->GetForeignPaths != rootGetForeignPaths)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a root_fdw foreign table",
+						get_rel_name(relid))));
+}
+
+/*
+ * rootGetForeignRelSize
+ *		Obtain relation size estimates for a foreign table
+ */
+static void
+rootGetForeignRelSize(PlannerInfo *root,
+					  RelOptInfo *baserel,
+					  Oid foreigntableid)
+{
+	RootFdwPlanState   *fdw_private;
+
+	/* Fetch options and shard contents */
+	fdw_private = get_plan_state(foreigntableid);
+	baserel->fdw_private = (void *) fdw_private;
+
+	/* Split restriction clauses into those the cursor loop can check */
+	classify_conditions(baserel, fdw_private, foreigntableid);
+
+	/* Estimate relation size */
+	estimate_size(root, baserel, fdw_private);
+}
+
+/*
+ * rootGetForeignPaths
+ *		Create possible access paths for a scan on the foreign table
+ *
+ *		The full scan returns all matching records in the order of the
+ *		files, which is ascending tree id order, and also the order of the
+ *		branch given by the 'sorted_by' option, if any.  Parameterized
+ *		paths look up tree ids, and partial paths scan files in parallel
+ *		in no particular order.
+ */
+static void
+rootGetForeignPaths(PlannerInfo *root,
+					RelOptInfo *baserel,
+					Oid foreigntableid)
+{
+	RootFdwPlanState *fdw_private = (RootFdwPlanState *) baserel->fdw_private;
+	Cost		startup_cost;
+	Cost		total_cost;
+	List	   *attrs;
+	List	   *private;
+	List	   *tree_pathkeys;
+	List	   *sorted_pathkeys;
+
+	/* Collect attributes used by the query */
+	attrs = collect_attributes(baserel, fdw_private, foreigntableid);
+
+	/* Estimate costs */
+	estimate_costs(root, baserel, fdw_private, attrs, 1.0,
+				   &startup_cost, &total_cost);
+
+	/* Build private list with one entry per attribute */
+	private = serialize_attributes(attrs);
+
+	/*
+	 * Files are read in the order of the catalog, so the full scan returns
+	 * entries by ascending tree id.  Collection ids restart with every tree
+	 * entry, so nothing is known of their order.
+	 */
+	tree_pathkeys = get_column_pathkeys(root, baserel, foreigntableid,
+										fdw_private->tree_attno);
+
+	/*
+	 * Create a ForeignPath node and add it as the non-parallel path.  We use
+	 * the fdw_private list of the path to carry the attributes to read; it
+	 * will be propagated into the fdw_private list of the Plan node.
+	 */
+	add_path(baserel, (Path *)
+			 create_foreignscan_path(root, baserel,
+									 NULL,		/* default pathtarget */
+									 baserel->rows,
+									 startup_cost,
+									 total_cost,
+									 tree_pathkeys,
+									 NULL,		/* no outer rel either */
+									 NULL,		/* no extra plan */
+									 private));
+
+	/*
+	 * The same scan also delivers entries in the order of the branch the
+	 * table is declared to be sorted by; ties keep their tree id order.  The
+	 * path has the same cost, so add_path keeps it only if its order is
+	 * useful to the query.
+	 */
+	sorted_pathkeys = get_column_pathkeys(root, baserel, foreigntableid,
+										  fdw_private->sorted_attno);
+	if (sorted_pathkeys != NIL)
+	{
+		add_path(baserel, (Path *)
+				 create_foreignscan_path(root, baserel,
+										 NULL,		/* default pathtarget */
+										 baserel->rows,
+										 startup_cost,
+										 total_cost,
+										 list_concat(sorted_pathkeys,
+													 list_copy(tree_pathkeys)),
+										 NULL,		/* no outer rel either */
+										 NULL,		/* no extra plan */
+										 private));
+	}
+
+	/* Add paths looking up the tree ids given by joins */
+	add_lookup_paths(root, baserel, fdw_private, attrs, private);
+
+	/*
+	 * Files of a shard can be scanned independently, so if there is more
+	 * than one, add a partial path where workers claim files from a shared
+	 * counter.
+	 */
+	if (baserel->consider_parallel && fdw_private->nfiles > 1)
+	{
+		int			parallel_workers;
+		double		pages;
+		double		width;
+
+		estimate_read_size(fdw_private, attrs, &pages, &width);
+		parallel_workers = compute_parallel_worker(baserel, pages, -1);
+		parallel_workers = Min(parallel_workers, fdw_private->nfiles - 1);
+
+		if (parallel_workers > 0)
+		{
+			double		parallel_divisor;
+			ForeignPath *path;
+
+			parallel_divisor = root_parallel_divisor(parallel_workers);
+			estimate_costs(root, baserel, fdw_private, attrs,
+						   parallel_divisor, &startup_cost, &total_cost);
+
+			path = create_foreignscan_path(root, baserel,
+										   NULL,	/* default pathtarget */
+										   clamp_row_est(baserel->rows /
+														 parallel_divisor),
+										   startup_cost,
+										   total_cost,
+										   NIL,		/* no pathkeys */
+										   NULL,	/* no outer rel either */
+										   NULL,	/* no extra plan */
+										   private);
+			path->path.parallel_aware = true;
+			path->path.parallel_safe = true;
+			path->path.parallel_workers = parallel_workers;
+
+			add_partial_path(baserel, (Path *) path);
+		}
+	}
+}
+
+/*
+ * Build the list of attributes stored in the private list of a path.  Plans
+ * are copied and sent to parallel workers, so each attribute is described by
+ * plain nodes: its ROOT name, its ROOT type, its attribute number, its
+ * position in the tuple and whether it is an array.
+ */
+static List *
+serialize_attributes(List *attrs)
+{
+	List	   *private = NIL;
+	ListCell   *lc;
+
+	foreach(lc, attrs)
+	{
+		QueryAttr *qattr = (QueryAttr *) lfirst(lc);
+
+		private = lappend(private,
+						  lappend(list_make4(makeString(pstrdup(qattr->attr->attname)),
+											 makeInteger(qattr->attr->atttype),
+											 makeInteger(qattr->attno),
+											 makeInteger(qattr->pos)),
+								  makeInteger(qattr->attr->isarray)));
+	}
+
+	return private;
+}
+
+/*
+ * Resolve the columns of a foreign table to the attributes of its ROOT
+ * schema, matching names case-insensitively through a hashed index of the
+ * schema.  Also find the attribute numbers of the tree id column and of the
+ * column of the branch given by the 'sorted_by' option; either is set to
+ * InvalidAttrNumber if the table has no such column.
+ */
+static void
+resolve_columns(Oid foreigntableid, RootFdwPlanState *fdw_private)
+{
+	Relation	rel;
+	TupleDesc	tupdesc;
+	HASHCTL		ctl;
+	HTAB	   *index;
+	RootAttrIndexEntry *ientry;
+	char		key[NAMEDATALEN];
+	bool		found;
+	ListCell   *lc;
+	int			i;
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = NAMEDATALEN;
+	ctl.entrysize = sizeof(RootAttrIndexEntry);
+	ctl.hcxt = CurrentMemoryContext;
+	index = hash_create("root_fdw schema index",
+						Max(list_length(fdw_private->schema), 16), &ctl,
+						HASH_ELEM | HASH_CONTEXT);
+
+	/*
+	 * The first attribute of a name wins, as it did for a scan of the schema.
+	 * Names too long for a column can't be matched and are left out.
+	 */
+	foreach(lc, fdw_private->schema)
+	{
+		RootAttr   *rattr = (RootAttr *) lfirst(lc);
+
+		if (strlen(rattr->attname) >= NAMEDATALEN)
+			continue;
+		for (i = 0; rattr->attname[i] != '\0'; i++)
+			key[i] = pg_tolower((unsigned char) rattr->attname[i]);
+		key[i] = '\0';
+
+		ientry = (RootAttrIndexEntry *) hash_search(index, key, HASH_ENTER,
+													&found);
+		if (!found)
+			ientry->attr = rattr;
+	}
+
+	fdw_private->tree_attno = InvalidAttrNumber;
+	fdw_private->sorted_attno = InvalidAttrNumber;
+
+	rel = heap_open(foreigntableid, AccessShareLock);
+	tupdesc = RelationGetDescr(rel);
+	fdw_private->ncolumns = tupdesc->natts;
+	fdw_private->columns = (RootAttr **) palloc0(Max(tupdesc->natts, 1) *
+												sizeof(RootAttr *));
+	for (i = 1; i <= tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i - 1];
+		const char *attname = NameStr(attr->attname);
+		RootAttr   *rattr;
+		int			j;
+
+		if (attr->attisdropped)
+			continue;
+
+		for (j = 0; attname[j] != '\0'; j++)
+			key[j] = pg_tolower((unsigned char) attname[j]);
+		key[j] = '\0';
+
+		ientry = (RootAttrIndexEntry *) hash_search(index, key, HASH_FIND,
+													NULL);
+		if (ientry == NULL)
+			continue;
+		rattr = ientry->attr;
+		fdw_private->columns[i - 1] = rattr;
+
+		if (rattr->atttype == RootTreeId)
+			fdw_private->tree_attno = attr->attnum;
+		else if (fdw_private->sorted_by != NULL &&
+				 strcmp(rattr->attname, fdw_private->sorted_by) == 0)
+			fdw_private->sorted_attno = attr->attnum;
+	}
+	heap_close(rel, AccessShareLock);
+
+	hash_destroy(index);
+}
+
+/*
+ * Build the pathkeys of a scan returning entries in ascending order of a
+ * column.  Returns NIL if the query has no use for that order.
+ */
+static List *
+get_column_pathkeys(PlannerInfo *root, RelOptInfo *baserel,
+					Oid foreigntableid, AttrNumber attno)
+{
+	TypeCacheEntry *typentry;
+	Oid			type;
+	int32		typmod;
+	Oid			collid;
+	Var		   *var;
+
+	if (attno == InvalidAttrNumber)
+		return NIL;
+
+	get_atttypetypmodcoll(foreigntableid, attno, &type, &typmod, &collid);
+	typentry = lookup_type_cache(type, TYPECACHE_LT_OPR);
+	if (!OidIsValid(typentry->lt_opr))
+		return NIL;
+
+	var = makeVar(baserel->relid, attno, type, typmod, collid, 0);
+
+	return build_expression_pathkey(root, (Expr *) var, NULL,
+									typentry->lt_opr, baserel->relids,
+									false);
+}
+
+/*
+ * Add parameterized paths for join clauses comparing the tree id column for
+ * equality with columns of other relations, as in a join of a tree with a
+ * list of selected entries.
+ *
+ * librootcursor can't seek to an entry, so each lookup opens only the file
+ * holding the tree id and advances the cursor up to it.  A lookup is costed
+ * as reading half of one file.  Lookups of ascending ids go on from where
+ * the previous one stopped, so they are cheaper than that in practice.
+ */
+static void
+add_lookup_paths(PlannerInfo *root, RelOptInfo *baserel,
+				 RootFdwPlanState *fdw_private, List *attrs, List *private)
+{
+	List	   *clauses = NIL;
+	List	   *ppi_list = NIL;
+	ListCell   *lc;
+	Cost		startup_cost;
+	Cost		total_cost;
+	Cost		run_cost;
+
+	if (fdw_private->tree_attno == InvalidAttrNumber)
+		return;
+
+	/* Join clauses that are not part of an equivalence class */
+	foreach(lc, baserel->joininfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		if (get_tree_id_param(rinfo, baserel, fdw_private->tree_attno))
+			clauses = lappend(clauses, rinfo);
+	}
+
+	/* Join clauses implied by equivalence classes of the tree id column */
+	if (baserel->has_eclass_joins)
+	{
+		clauses = list_concat(clauses,
+							  generate_implied_equalities_for_column(root,
+																	 baserel,
+																	 ec_member_matches_tree_id,
+																	 (void *) &fdw_private->tree_attno,
+																	 baserel->lateral_referencers));
+	}
+
+	if (clauses == NIL)
+		return;
+
+	estimate_costs(root, baserel, fdw_private, attrs, 1.0,
+				   &startup_cost, &total_cost);
+	run_cost = (total_cost - startup_cost) /
+		(2.0 * Max(fdw_private->nfiles, 1));
+
+	foreach(lc, clauses)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		Relids		required_outer;
+		ParamPathInfo *param_info;
+
+		if (!join_clause_is_movable_to(rinfo, baserel) ||
+			get_tree_id_param(rinfo, baserel, fdw_private->tree_attno) == NULL)
+			continue;
+
+		required_outer = bms_union(rinfo->clause_relids,
+								   baserel->lateral_relids);
+		required_outer = bms_del_member(required_outer, baserel->relid);
+		if (bms_is_empty(required_outer))
+			continue;
+
+		/* One path per set of outer relations is enough */
+		param_info = get_baserel_parampathinfo(root, baserel, required_outer);
+		if (list_member_ptr(ppi_list, param_info))
+			continue;
+		ppi_list = lappend(ppi_list, param_info);
+
+		add_path(baserel, (Path *)
+				 create_foreignscan_path(root, baserel,
+										 NULL,	/* default pathtarget */
+										 param_info->ppi_rows,
+										 startup_cost,
+										 startup_cost + run_cost,
+										 NIL,	/* no pathkeys */
+										 required_outer,
+										 NULL,	/* no extra plan */
+										 private));
+	}
+}
+
+/*
+ * Callback for generate_implied_equalities_for_column, matching the tree id
+ * column of the scanned relation.
+ */
+static bool
+ec_member_matches_tree_id(PlannerInfo *root, RelOptInfo *rel,
+						  EquivalenceClass *ec, EquivalenceMember *em,
+						  void *arg)
+{
+	AttrNumber	tree_attno = *((AttrNumber *) arg);
+
+	return is_root_column((Node *) em->em_expr, rel->relid) &&
+		((Var *) em->em_expr)->varattno == tree_attno;
+}
+
+/*
+ * If a clause compares the tree id column of the scanned relation for
+ * equality with an integer expression of other relations, return that
+ * expression.
+ */
+static Expr *
+get_tree_id_param(RestrictInfo *rinfo, RelOptInfo *baserel,
+				  AttrNumber tree_attno)
+{
+	OpExpr	   *op = (OpExpr *) rinfo->clause;
+	Node	   *left;
+	Node	   *right;
+	Node	   *other;
+
+	if (tree_attno == InvalidAttrNumber ||
+		!IsA(op, OpExpr) || list_length(op->args) != 2)
+		return NULL;
+
+	left = (Node *) linitial(op->args);
+	right = (Node *) lsecond(op->args);
+	if (is_root_column(left, baserel->relid) &&
+		((Var *) left)->varattno == tree_attno)
+		other = right;
+	else if (is_root_column(right, baserel->relid) &&
+			 ((Var *) right)->varattno == tree_attno)
+		other = left;
+	else
+		return NULL;
+
+	if (bms_is_member(baserel->relid, pull_varnos(other)) ||
+		contain_volatile_functions(other))
+		return NULL;
+
+	switch (exprType(other))
+	{
+	case INT2OID:
+	case INT4OID:
+	case INT8OID:
+		break;
+	default:
+		return NULL;
+	}
+
+	if (get_op_opfamily_strategy(op->opno, INTEGER_BTREE_FAM_OID) !=
+		BTEqualStrategyNumber)
+		return NULL;
+
+	return (Expr *) other;
+}
+
+/*
+ * rootGetForeignPlan
+ *		Create a ForeignScan plan node for scanning the foreign table
+ */
+static ForeignScan *
+rootGetForeignPlan(PlannerInfo *root,
+				   RelOptInfo *baserel,
+				   Oid foreigntableid,
+				   ForeignPath *best_path,
+				   List *tlist,
+				   List *scan_clauses,
+				   Plan *outer_plan)
+{
+	RootFdwPlanState *fdw_private = (RootFdwPlanState *) baserel->fdw_private;
+	Index		scan_relid = baserel->relid;
+	List	   *local_exprs = NIL;
+	List	   *remote_exprs = NIL;
+	List	   *fdw_exprs = NIL;
+	List	   *private;
+	ListCell   *lc;
+
+	/* Aggregates computed by the cursor loop get a plan of their own */
+	if (IS_UPPER_REL(baserel))
+		return create_aggregate_plan(baserel, best_path, tlist);
+
+	/* So do joins of a tree with one of its collections */
+	if (IS_JOIN_REL(baserel))
+		return create_join_plan(root, baserel, tlist);
+
+	/*
+	 * Separate the scan_clauses into those that can be checked by the cursor
+	 * loop and those that can't.  Clauses classified as pushable are handed
+	 * to rootBeginForeignScan through the private list; the rest go into the
+	 * plan node's qual list for the executor to check.  In either case, we
+	 * strip RestrictInfo nodes from the clauses and ignore pseudoconstants
+	 * (which will be handled elsewhere).
+	 */
+	foreach(lc, scan_clauses)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		Assert(IsA(rinfo, RestrictInfo));
+
+		if (rinfo->pseudoconstant)
+			continue;
+
+		if (list_member_ptr(fdw_private->remote_conds, rinfo))
+			remote_exprs = lappend(remote_exprs, rinfo->clause);
+		else
+			local_exprs = lappend(local_exprs, rinfo->clause);
+	}
+
+	/*
+	 * A parameterized path looks up the tree id given by one of its join
+	 * clauses, which the executor evaluates for each rescan.  The clause
+	 * itself is still checked along with the other local conditions.
+	 */
+	if (best_path->path.param_info)
+	{
+		foreach(lc, best_path->path.param_info->ppi_clauses)
+		{
+			Expr	   *param;
+
+			param = get_tree_id_param((RestrictInfo *) lfirst(lc), baserel,
+									  fdw_private->tree_attno);
+			if (param != NULL)
+			{
+				fdw_exprs = list_make1(param);
+				break;
+			}
+		}
+	}
+
+	/* Build private list of the plan node */
+	private = build_scan_private(fdw_private, best_path->fdw_private,
+								 remote_exprs);
+
+	/* Create the ForeignScan node */
+	return make_foreignscan(tlist,
+							local_exprs,
+							scan_relid,
+							fdw_exprs,
+							private,
+							NIL,	/* no custom tlist */
+							NIL,	/* no remote quals */
+							NULL);	/* no outer plan */
+}
+
+/*
+ * rootGetForeignJoinPaths
+ *		Add a path joining a tree table with a collection table of the same
+ *		tree on the same shard
+ *
+ *		Collection entries are nested in tree entries, so an inner join on
+ *		the tree id is computed by the scan of the collection, which moves a
+ *		cursor on the tree along with its own through each file.  Both
+ *		cursors are opened on the same ROOT instance, and no hash table is
+ *		built.  Conditions of each table checked by the cursor loop are
+ *		checked by its cursor; other conditions are left to the executor.
+ */
+static void
+rootGetForeignJoinPaths(PlannerInfo *root, RelOptInfo *joinrel,
+						RelOptInfo *outerrel, RelOptInfo *innerrel,
+						JoinType jointype, JoinPathExtraData *extra)
+{
+	RootFdwJoinState *join_state;
+	RootFdwPlanState *tree_private;
+	RootFdwPlanState *coll_private;
+	RelOptInfo *tree_rel;
+	RelOptInfo *coll_rel;
+	List	   *local_conds = NIL;
+	List	   *vars;
+	List	   *attrs;
+	ListCell   *lc;
+	bool		has_join_clause = false;
+	QualCost	local_cost;
+	Cost		tree_startup_cost;
+	Cost		tree_total_cost;
+	Cost		startup_cost;
+	Cost		total_cost;
+
+	/* Both orders of the same join get the same path */
+	if (joinrel->fdw_private != NULL)
+		return;
+
+	/*
+	 * Only inner joins of two plain ROOT tables are supported.  Rows of the
+	 * join can't be locked or rechecked, so queries with row marks are left
+	 * alone.
+	 */
+	if (jointype != JOIN_INNER ||
+		outerrel->reloptkind != RELOPT_BASEREL ||
+		innerrel->reloptkind != RELOPT_BASEREL ||
+		outerrel->fdw_private == NULL || innerrel->fdw_private == NULL ||
+		!bms_is_empty(joinrel->lateral_relids) ||
+		root->rowMarks != NIL)
+		return;
+
+	/* One side must be a collection of the tree of the other side */
+	if (((RootFdwPlanState *) outerrel->fdw_private)->is_collection)
+	{
+		coll_rel = outerrel;
+		tree_rel = innerrel;
+	}
+	else
+	{
+		tree_rel = outerrel;
+		coll_rel = innerrel;
+	}
+	tree_private = (RootFdwPlanState *) tree_rel->fdw_private;
+	coll_private = (RootFdwPlanState *) coll_rel->fdw_private;
+
+	if (tree_private->is_collection || !coll_private->is_collection ||
+		!equal(tree_private->shards, coll_private->shards) ||
+		strcmp(tree_private->tree, coll_private->tree) != 0 ||
+		tree_private->tree_attno == InvalidAttrNumber ||
+		coll_private->tree_attno == InvalidAttrNumber)
+		return;
+
+	/*
+	 * The join must be on the tree id, which the cursors enforce.  Other
+	 * join clauses, and the conditions of either table the cursors can't
+	 * check, are checked on the joined rows.
+	 */
+	foreach(lc, extra->restrictlist)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		if (rinfo->pseudoconstant)
+			return;
+
+		if (is_tree_id_join_clause(rinfo,
+								   tree_rel, tree_private->tree_attno,
+								   coll_rel, coll_private->tree_attno))
+			has_join_clause = true;
+		else
+			local_conds = lappend(local_conds, rinfo);
+	}
+	if (!has_join_clause)
+		return;
+
+	local_conds = list_concat(local_conds, list_copy(tree_private->local_conds));
+	local_conds = list_concat(local_conds, list_copy(coll_private->local_conds));
+
+	/* The joined rows are made of plain columns of either table */
+	vars = pull_var_clause((Node *) joinrel->reltarget->exprs,
+						   PVC_RECURSE_PLACEHOLDERS);
+	vars = list_concat(vars,
+					   pull_var_clause((Node *) extract_actual_clauses(local_conds,
+																	   false),
+									   PVC_RECURSE_PLACEHOLDERS));
+	foreach(lc, vars)
+	{
+		Var		   *var = (Var *) lfirst(lc);
+		RootAttr   *rattr;
+
+		if (!is_root_column((Node *) var, 0))
+			return;
+
+		/* Arrays of the tree are only read by scans of their own */
+		rattr = get_root_attr(var->varno == tree_rel->relid ?
+							  tree_private : coll_private, var->varattno);
+		if (rattr != NULL && rattr->isarray)
+			return;
+	}
+
+	/*
+	 * Both tables are read as they would be by their own scans, but entries
+	 * of the tree are never turned into tuples; joined rows are, and are
+	 * checked by the conditions left to the executor.
+	 */
+	attrs = collect_attributes(tree_rel, tree_private,
+							   planner_rt_fetch(tree_rel->relid, root)->relid);
+	estimate_costs(root, tree_rel, tree_private, attrs, 1.0,
+				   &tree_startup_cost, &tree_total_cost);
+	tree_total_cost -= cpu_tuple_cost * 1.5 * tree_private->ntuples;
+
+	attrs = collect_attributes(coll_rel, coll_private,
+							   planner_rt_fetch(coll_rel->relid, root)->relid);
+	estimate_costs(root, coll_rel, coll_private, attrs, 1.0,
+				   &startup_cost, &total_cost);
+
+	cost_qual_eval(&local_cost, extract_actual_clauses(local_conds, false),
+				   root);
+	startup_cost += tree_startup_cost + local_cost.startup;
+	total_cost += tree_total_cost + local_cost.startup +
+		local_cost.per_tuple * joinrel->rows;
+
+	join_state = (RootFdwJoinState *) palloc0(sizeof(RootFdwJoinState));
+	join_state->tree_rel = tree_rel;
+	join_state->coll_rel = coll_rel;
+	join_state->local_conds = local_conds;
+	joinrel->fdw_private = join_state;
+
+	add_path(joinrel, (Path *)
+			 create_foreignscan_path(root, joinrel,
+									 NULL,		/* default pathtarget */
+									 joinrel->rows,
+									 startup_cost,
+									 total_cost,
+									 NIL,		/* no pathkeys */
+									 NULL,		/* no outer rel either */
+									 NULL,		/* no extra plan */
+									 NIL));		/* built by the plan */
+}
+
+/*
+ * Does a join clause compare the tree id columns of a tree table and of a
+ * collection table for equality?
+ */
+static bool
+is_tree_id_join_clause(RestrictInfo *rinfo,
+					   RelOptInfo *tree_rel, AttrNumber tree_attno,
+					   RelOptInfo *coll_rel, AttrNumber coll_attno)
+{
+	Expr	   *other;
+
+	other = get_tree_id_param(rinfo, tree_rel, tree_attno);
+
+	return other != NULL &&
+		is_root_column((Node *) other, coll_rel->relid) &&
+		((Var *) other)->varattno == coll_attno;
+}
+
+/*
+ * Create a ForeignScan plan node joining a tree table with a collection
+ * table.  The scan has no relation of its own; it returns the columns of
+ * both tables listed in fdw_scan_tlist, which the plan above refers to.
+ */
+static ForeignScan *
+create_join_plan(PlannerInfo *root, RelOptInfo *joinrel, List *tlist)
+{
+	RootFdwJoinState *join_state = (RootFdwJoinState *) joinrel->fdw_private;
+	List	   *local_exprs;
+	List	   *fdw_scan_tlist;
+	List	   *private;
+
+	local_exprs = extract_actual_clauses(join_state->local_conds, false);
+
+	/* Columns needed above the join and by the conditions left to check */
+	fdw_scan_tlist = add_to_flat_tlist(NIL,
+									   pull_var_clause((Node *) joinrel->reltarget->exprs,
+													   PVC_RECURSE_PLACEHOLDERS));
+	fdw_scan_tlist = add_to_flat_tlist(fdw_scan_tlist,
+									   pull_var_clause((Node *) local_exprs,
+													   PVC_RECURSE_PLACEHOLDERS));
+
+	/* Build private list of the plan node */
+	private = list_make2(build_join_scan_private(root, join_state->tree_rel,
+												 fdw_scan_tlist),
+						 build_join_scan_private(root, join_state->coll_rel,
+												 fdw_scan_tlist));
+
+	return make_foreignscan(tlist,
+							local_exprs,
+							0,		/* no relation scanned */
+							NIL,	/* no expressions to evaluate */
+							private,
+							fdw_scan_tlist,
+							NIL,	/* no remote quals */
+							NULL);	/* no outer plan */
+}
+
+/*
+ * Build the private list of the scan of one side of a join.  Each attribute
+ * read is stored at the position of its column in fdw_scan_tlist, if the
+ * join returns it.
+ */
+static List *
+build_join_scan_private(PlannerInfo *root, RelOptInfo *rel,
+						List *fdw_scan_tlist)
+{
+	RootFdwPlanState *fdw_private = (RootFdwPlanState *) rel->fdw_private;
+	List	   *attrs;
+	ListCell   *lc;
+
+	attrs = collect_attributes(rel, fdw_private,
+							   planner_rt_fetch(rel->relid, root)->relid);
+	foreach(lc, attrs)
+	{
+		QueryAttr  *qattr = (QueryAttr *) lfirst(lc);
+		ListCell   *tlc;
+
+		qattr->pos = -1;
+		foreach(tlc, fdw_scan_tlist)
+		{
+			TargetEntry *tle = (TargetEntry *) lfirst(tlc);
+			Var		   *var = (Var *) tle->expr;
+
+			if (var->varno == rel->relid && var->varattno == qattr->attno)
+			{
+				qattr->pos = tle->resno - 1;
+				break;
+			}
+		}
+	}
+
+	return build_scan_private(fdw_private, serialize_attributes(attrs),
+							  extract_actual_clauses(fdw_private->remote_conds,
+													 false));
+}
+
+/*
+ * rootGetForeignUpperPaths
+ *		Add a path computing the aggregates of a grouping query in the
+ *		cursor loop
+ *
+ *		Simple aggregates (count, sum, min, max, and avg of floats) over the
+ *		columns of a single ROOT table, optionally grouped by one integer
+ *		column, are computed over the entries of each batch, without forming
+ *		a tuple per entry.  Every restriction clause must be checked by the
+ *		cursor loop, as no executor quals are left below the aggregation.
+ */
+static void
+rootGetForeignUpperPaths(PlannerInfo *root, UpperRelationKind stage,
+						 RelOptInfo *input_rel, RelOptInfo *output_rel)
+{
+	RootFdwPlanState *fdw_private;
+	Query	   *parse = root->parse;
+	PathTarget *target;
+	Oid			foreigntableid;
+	List	   *attrs;
+	List	   *outputs = NIL;
+	List	   *remote_exprs = NIL;
+	List	   *private;
+	ListCell   *lc;
+	bool		grouped = false;
+	bool		count_only;
+	double		ngroups = 1;
+	Cost		startup_cost;
+	Cost		total_cost;
+	int			i;
+
+	/* Only grouping of a plain scan of a ROOT table is supported */
+	if (stage != UPPERREL_GROUP_AGG || output_rel->fdw_private != NULL)
+		return;
+	if (input_rel->reloptkind != RELOPT_BASEREL ||
+		input_rel->fdw_private == NULL)
+		return;
+
+	fdw_private = (RootFdwPlanState *) input_rel->fdw_private;
+
+	if (parse->groupingSets != NIL || root->hasHavingQual ||
+		list_length(parse->groupClause) > 1 ||
+		fdw_private->local_conds != NIL)
+		return;
+
+	foreach(lc, input_rel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		if (rinfo->pseudoconstant)
+			return;
+		remote_exprs = lappend(remote_exprs, rinfo->clause);
+	}
+
+	foreigntableid = planner_rt_fetch(input_rel->relid, root)->relid;
+
+	/* Every output must be the grouping column or a supported aggregate */
+	target = root->upper_targets[UPPERREL_GROUP_AGG];
+	i = 0;
+	foreach(lc, target->exprs)
+	{
+		Expr	   *expr = (Expr *) lfirst(lc);
+		Index		sgref = get_pathtarget_sortgroupref(target, i);
+		bool		is_group;
+		List	   *output;
+
+		is_group = sgref != 0 &&
+			get_sortgroupref_clause_noerr(sgref, parse->groupClause) != NULL;
+
+		output = build_root_agg(expr, is_group, input_rel, fdw_private,
+								foreigntableid);
+		if (output == NIL)
+			return;
+
+		if (is_group)
+			grouped = true;
+		outputs = lappend(outputs, output);
+		i++;
+	}
+
+	if (parse->groupClause != NIL && !grouped)
+		return;
+
+	/*
+	 * count(*) over a whole tree is the number of entries of its files,
+	 * which are known from their metadata, so no basket needs to be read.
+	 * Tree ids rely on these counts being exact.
+	 */
+	count_only = !grouped && remote_exprs == NIL &&
+		!fdw_private->is_collection;
+	foreach(lc, outputs)
+	{
+		if (intVal(linitial((List *) lfirst(lc))) != RootAggCount)
+			count_only = false;
+	}
+
+	/* Read the same attributes as the scan of the input relation */
+	attrs = collect_attributes(input_rel, fdw_private, foreigntableid);
+
+	if (grouped)
+	{
+		List	   *group_exprs;
+
+		group_exprs = get_sortgrouplist_exprs(parse->groupClause,
+											  parse->targetList);
+		ngroups = estimate_num_groups(root, group_exprs, input_rel->rows,
+									  NULL);
+	}
+
+	/*
+	 * Aggregates are computed while scanning, so everything happens before
+	 * the first group is returned.  Entries are never turned into tuples,
+	 * which saves the per-tuple cost charged by the scan.
+	 */
+	if (count_only)
+	{
+		startup_cost = 0;
+	}
+	else
+	{
+		estimate_costs(root, input_rel, fdw_private, attrs, 1.0,
+					   &startup_cost, &total_cost);
+		startup_cost = total_cost - cpu_tuple_cost * fdw_private->ntuples;
+		startup_cost += cpu_operator_cost * ROOT_AGG_TRANSITION_COST *
+			list_length(outputs) * input_rel->rows;
+	}
+	total_cost = startup_cost + cpu_tuple_cost * ngroups;
+
+	private = list_make4(serialize_attributes(attrs),
+						 outputs,
+						 remote_exprs,
+						 makeInteger(count_only));
+
+	/* Planning the aggregate scan needs the state of the input relation */
+	output_rel->fdw_private = fdw_private;
+
+	add_path(output_rel, (Path *)
+			 create_foreignscan_path(root, output_rel,
+									 target,
+									 ngroups,
+									 startup_cost,
+									 total_cost,
+									 NIL,		/* no pathkeys */
+									 NULL,		/* no outer rel either */
+									 NULL,		/* no extra plan */
+									 private));
+}
+
+/*
+ * Describe an output column of a grouping query computed by the cursor loop,
+ * as a list of its RootAggKind, the attribute number of its input and the
+ * PostgreSQL type of its result.
+ *
+ * Only aggregates from pg_catalog with results the cursor loop can compute
+ * exactly are supported: count(*) and count of any column, sum of int4 and
+ * float8, min and max of int4, int8 and float8, and avg of float8.  The
+ * grouping column must be an integer column.
+ *
+ * Returns NIL if the expression can't be computed by the cursor loop.
+ */
+static List *
+build_root_agg(Expr *expr, bool is_group, RelOptInfo *input_rel,
+			   RootFdwPlanState *fdw_private, Oid foreigntableid)
+{
+	Aggref	   *aggref = (Aggref *) expr;
+	Var		   *var = NULL;
+	RootAttr   *rattr = NULL;
+	RootAggKind kind;
+	char	   *aggname;
+	bool		is_int;
+	bool		is_float;
+
+	if (is_group)
+	{
+		var = (Var *) expr;
+		kind = RootAggGroup;
+	}
+	else
+	{
+		if (!IsA(expr, Aggref) ||
+			aggref->aggsplit != AGGSPLIT_SIMPLE ||
+			aggref->aggkind != AGGKIND_NORMAL ||
+			aggref->agglevelsup != 0 ||
+			aggref->aggdistinct != NIL ||
+			aggref->aggorder != NIL ||
+			aggref->aggdirectargs != NIL ||
+			aggref->aggfilter != NULL ||
+			get_func_namespace(aggref->aggfnoid) != PG_CATALOG_NAMESPACE)
+			return NIL;
+
+		if (!aggref->aggstar)
+		{
+			TargetEntry *tle;
+
+			if (list_length(aggref->args) != 1)
+				return NIL;
+			tle = (TargetEntry *) linitial(aggref->args);
+			var = (Var *) tle->expr;
+		}
+
+		aggname = get_func_name(aggref->aggfnoid);
+		if (strcmp(aggname, "count") == 0)
+			kind = RootAggCount;
+		else if (strcmp(aggname, "sum") == 0)
+			kind = RootAggSum;
+		else if (strcmp(aggname, "min") == 0)
+			kind = RootAggMin;
+		else if (strcmp(aggname, "max") == 0)
+			kind = RootAggMax;
+		else if (strcmp(aggname, "avg") == 0)
+			kind = RootAggAvg;
+		else
+			return NIL;
+	}
+
+	/* count(*) needs no input */
+	if (var == NULL)
+	{
+		if (kind != RootAggCount)
+			return NIL;
+		return list_make3(makeInteger(kind), makeInteger(0),
+						  makeInteger(aggref->aggtype));
+	}
+
+	if (!is_root_column((Node *) var, input_rel->relid))
+		return NIL;
+
+	rattr = get_root_attr(fdw_private, var->varattno);
+	if (rattr == NULL || rattr->isarray)
+		return NIL;
+
+	is_int = rattr->atttype == RootTreeId ||
+		rattr->atttype == RootCollectionId ||
+		rattr->atttype == RootInt ||
+		rattr->atttype == RootUInt;
+	is_float = rattr->atttype == RootFloat;
+
+	/* Unsigned values read as integer are range-checked row by row */
+	if (rattr->atttype == RootUInt && var->vartype == INT4OID)
+		return NIL;
+
+	switch (kind)
+	{
+	case RootAggGroup:
+		if (!is_int || (var->vartype != INT4OID && var->vartype != INT8OID))
+			return NIL;
+		return list_make3(makeInteger(kind), makeInteger(var->varattno),
+						  makeInteger(var->vartype));
+	case RootAggCount:
+		break;
+	case RootAggSum:
+		if (!((is_int && var->vartype == INT4OID &&
+			   aggref->aggtype == INT8OID) ||
+			  (is_float && var->vartype == FLOAT8OID &&
+			   aggref->aggtype == FLOAT8OID)))
+			return NIL;
+		break;
+	case RootAggMin:
+	case RootAggMax:
+		if (!((is_int && (var->vartype == INT4OID ||
+						  var->vartype == INT8OID)) ||
+			  (is_float && var->vartype == FLOAT8OID)) ||
+			aggref->aggtype != var->vartype)
+			return NIL;
+		break;
+	case RootAggAvg:
+		if (!is_float || var->vartype != FLOAT8OID ||
+			aggref->aggtype != FLOAT8OID)
+			return NIL;
+		break;
+	}
+
+	return list_make3(makeInteger(kind), makeInteger(var->varattno),
+					  makeInteger(aggref->aggtype));
+}
+
+/*
+ * Create a ForeignScan plan node computing the aggregates of a grouping
+ * query.  The scan has no relation of its own; it returns the rows described
+ * by fdw_scan_tlist, one per group, which the plan above refers to.
+ */
+static ForeignScan *
+create_aggregate_plan(RelOptInfo *upperrel, ForeignPath *best_path,
+					  List *tlist)
+{
+	RootFdwPlanState *fdw_private = (RootFdwPlanState *) upperrel->fdw_private;
+	PathTarget *target = best_path->path.pathtarget;
+	List	   *path_private = best_path->fdw_private;
+	List	   *fdw_scan_tlist = NIL;
+	List	   *private;
+	ListCell   *lc;
+	int			i = 0;
+
+	foreach(lc, target->exprs)
+	{
+		TargetEntry *tle;
+
+		tle = makeTargetEntry((Expr *) lfirst(lc), i + 1, NULL, false);
+		tle->ressortgroupref = get_pathtarget_sortgroupref(target, i);
+		fdw_scan_tlist = lappend(fdw_scan_tlist, tle);
+		i++;
+	}
+
+	/* Build private list of the plan node */
+	private = build_scan_private(fdw_private, linitial(path_private),
+								 lthird(path_private));
+	private = lappend(private, lsecond(path_private));
+	private = lappend(private, lfourth(path_private));
+
+	return make_foreignscan(tlist,
+							NIL,	/* all conditions are in the cursor loop */
+							0,		/* no relation scanned */
+							NIL,	/* no expressions to evaluate */
+							private,
+							fdw_scan_tlist,
+							NIL,	/* no remote quals */
+							NULL);	/* no outer plan */
+}
+
+/*
+ * rootBeginForeignScan
+ *		Initiate access to the files of the shard.  Cursors are opened one
+ *		file at a time by rootIterateForeignScan.
+ */
+static void
+rootBeginForeignScan(ForeignScanState *node, int eflags)
+{
+	ForeignScan *plan = (ForeignScan *) node->ss.ps.plan;
+	RootFdwExecutionState  *festate;
+
+	/* Joins have a private list per table, scans start with the shard */
+	if (plan->scan.scanrelid == 0 && IsA(linitial(plan->fdw_private), List))
+		festate = create_join_state(plan->fdw_private,
+									node->ss.ps.state->es_query_cxt);
+	else
+		festate = create_execution_state(plan->fdw_private,
+										 node->ss.ps.state->es_query_cxt);
+
+	/* Save state in node->fdw_state */
+	node->fdw_state = (void *) festate;
+
+	/*
+	 * Work done is counted for the table scanned, and joins for the first
+	 * table joined.  Parallel workers only add their work to the scan of
+	 * the leader.
+	 */
+	if (node->ss.ss_currentRelation)
+		festate->relid = RelationGetRelid(node->ss.ss_currentRelation);
+	else
+		festate->relid = getrelid(bms_next_member(plan->fs_relids, -1),
+								  node->ss.ps.state->es_range_table);
+	festate->explain_only = (eflags & EXEC_FLAG_EXPLAIN_ONLY) != 0;
+	festate->timing = (node->ss.ps.instrument != NULL &&
+					   node->ss.ps.instrument->need_timer);
+	if (!festate->explain_only && !IsParallelWorker())
+		festate->scans++;
+
+	/*
+	 * Values are converted to the declared types of the columns.  Aggregate
+	 * scans compute their outputs from the values of the ROOT types.
+	 */
+	if (festate->agg == NULL)
+	{
+		TupleDesc	tupdesc = node->ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+
+		resolve_column_converters(festate, tupdesc);
+		if (festate->parent)
+			resolve_column_converters(festate->parent, tupdesc);
+	}
+
+	/* Parameterized scans look up the tree id given by fdw_exprs */
+	if (plan->fdw_exprs != NIL)
+	{
+		Expr	   *expr = (Expr *) linitial(plan->fdw_exprs);
+
+		festate->lookup = true;
+		festate->lookup_expr = ExecInitExpr(expr, (PlanState *) node);
+		festate->lookup_type = exprType((Node *) expr);
+		festate->lookup_attr = find_tree_id_attr(festate);
+		if (festate->lookup_attr < 0)
+		{
+			elog(ERROR, "ROOT lookup without tree id attribute");
+		}
+		festate->param_pending = true;
+	}
+
+	/*
+	 * Attributes that are not stored in the tuple are never read, so make
+	 * them null once and for all.
+	 */
+	memset(node->ss.ss_ScanTupleSlot->tts_isnull, true,
+		   node->ss.ss_ScanTupleSlot->tts_tupleDescriptor->natts * sizeof(bool));
+}
+
+/*
+ * Build the state of a scan from the private list of a ForeignScan plan
+ * node.  The state lives in a scan context created under cxt, and values
+ * read by the scan in a batch context under the scan context, so that
+ * deleting the scan context releases everything the scan allocated.
+ */
+static RootFdwExecutionState *
+create_execution_state(List *fdw_private, MemoryContext cxt)
+{
+	RootFdwExecutionState  *festate;
+	MemoryContext			scan_cxt;
+	MemoryContext			oldcxt;
+	ListCell   			   *lc;
+	List				   *attrs;
+	List				   *offsets;
+	List				   *remote_exprs;
+	int						nattrs;
+	int						nquals;
+	int						i = 0;
+
+	scan_cxt = AllocSetContextCreate(cxt,
+									 "root_fdw scan",
+									 ALLOCSET_SMALL_SIZES);
+	oldcxt = MemoryContextSwitchTo(scan_cxt);
+
+	festate = (RootFdwExecutionState *) palloc0(sizeof(RootFdwExecutionState));
+	festate->scan_cxt = scan_cxt;
+	festate->shards = (List *) list_nth(fdw_private, FdwScanPrivateShards);
+	festate->shard = get_shard_set(festate->shards);
+	festate->tree = strVal(list_nth(fdw_private, FdwScanPrivateTree));
+	festate->is_collection = intVal(list_nth(fdw_private,
+											 FdwScanPrivateIsCollection)) != 0;
+	festate->readahead = intVal(list_nth(fdw_private,
+										 FdwScanPrivateReadahead)) != 0;
+	attrs = (List *) list_nth(fdw_private, FdwScanPrivateAttrs);
+	offsets = (List *) list_nth(fdw_private, FdwScanPrivateOffsets);
+	remote_exprs = (List *) list_nth(fdw_private,
+									 FdwScanPrivateRemoteExprs);
+
+	/* Shard must not have changed since the plan was made */
+	if (list_length(offsets) != festate->shard->nfiles + 1)
+	{
+		elog(ERROR, "contents of ROOT's shard changed since query was planned");
+	}
+
+	/*
+	 * Tree ids are numbered from the entries the files have when the scan
+	 * starts rather than when it was planned, so that they stay unique if
+	 * files were rewritten since.
+	 */
+	festate->offsets = (int64 *) palloc((festate->shard->nfiles + 1) *
+										sizeof(int64));
+	festate->offsets[0] = 0;
+	for (i = 0; i < festate->shard->nfiles; i++)
+		festate->offsets[i + 1] = festate->offsets[i] +
+			get_file_entries(festate->shard, i, festate->tree, false);
+
+	/*
+	 * Build attributes to add to the cursor of each file.  Predicate
+	 * attributes come first, so they are registered before the payload
+	 * attributes.  Array attributes get readers of their own, and a room
+	 * is kept for the tree id they are read by.
+	 */
+	nattrs = list_length(attrs) + 1;
+	festate->attnames = (char **) palloc(nattrs * sizeof(char *));
+	festate->atttypes = (RootAttributeType *)
+		palloc(nattrs * sizeof(RootAttributeType));
+	festate->attnos = (AttrNumber *) palloc(nattrs * sizeof(AttrNumber));
+	festate->pos = (int *) palloc(nattrs * sizeof(int));
+	festate->proj = (int *) palloc(nattrs * sizeof(int));
+	festate->arrays = (RootArrayReader *) palloc0(nattrs *
+												  sizeof(RootArrayReader));
+	festate->nproj = 0;
+	festate->narrays = 0;
+	i = 0;
+	foreach(lc, attrs)
+	{
+		List	   *attr = (List *) lfirst(lc);
+
+		if (intVal(list_nth(attr, 4)))
+		{
+			RootArrayReader *reader = &festate->arrays[festate->narrays++];
+
+			reader->attname = strVal(linitial(attr));
+			reader->elemtype = (RootAttributeType) intVal(lsecond(attr));
+			reader->pos = intVal(lfourth(attr));
+			reader->typid = get_array_elem_type(reader->elemtype);
+			get_typlenbyvalalign(reader->typid, &reader->typlen,
+								 &reader->typbyval, &reader->typalign);
+			reader->maxelems = 16;
+			reader->elems = (Datum *) palloc(reader->maxelems * sizeof(Datum));
+			continue;
+		}
+
+		festate->attnames[i] = strVal(linitial(attr));
+		festate->atttypes[i] = (RootAttributeType) intVal(lsecond(attr));
+		festate->attnos[i] = (AttrNumber) intVal(lthird(attr));
+		festate->pos[i] = intVal(lfourth(attr));
+		if (festate->pos[i] >= 0)
+			festate->proj[festate->nproj++] = i;
+		i++;
+	}
+	festate->nattrs = i;
+	nattrs = i;
+
+	festate->tree_attr = -1;
+	if (festate->narrays > 0)
+	{
+		festate->tree_attr = find_tree_id_attr(festate);
+		if (festate->tree_attr < 0)
+		{
+			festate->attnames[nattrs] = psprintf("%s_id", festate->tree);
+			festate->atttypes[nattrs] = RootTreeId;
+			festate->attnos[nattrs] = InvalidAttrNumber;
+			festate->pos[nattrs] = -1;
+			festate->tree_attr = nattrs;
+			festate->nattrs = ++nattrs;
+		}
+	}
+
+	/*
+	 * Build conditions checked by the cursor loop.  Every column they refer
+	 * to was collected by collect_attributes, so it is registered in the
+	 * cursor.  The private list is not adjusted by setrefs, so the range
+	 * table index of their variables can't be checked against the scan's.
+	 */
+	nquals = list_length(remote_exprs);
+	festate->nquals = nquals;
+	festate->quals = (RootQual *) palloc(Max(nquals, 1) * sizeof(RootQual));
+	i = 0;
+	foreach(lc, remote_exprs)
+	{
+		RootQual   *qual = &festate->quals[i];
+		int			j;
+
+		if (!build_root_qual((Expr *) lfirst(lc), 0, qual))
+		{
+			elog(ERROR, "unsupported ROOT cursor condition");
+		}
+
+		for (j = 0; j < nattrs; j++)
+		{
+			if (festate->attnos[j] == qual->attno)
+				break;
+		}
+		if (j == nattrs)
+		{
+			elog(ERROR, "ROOT cursor condition refers to unknown attribute");
+		}
+
+		qual->index = j;
+		qual->atttype = festate->atttypes[j];
+		i++;
+	}
+
+	/* Files whose zones exclude the values wanted are skipped */
+	festate->skip = NULL;
+	if (nquals > 0)
+	{
+		char	  **branches = (char **) palloc(nquals * sizeof(char *));
+
+		for (i = 0; i < nquals; i++)
+			branches[i] = festate->attnames[festate->quals[i].index];
+		festate->skip = get_skipped_files((List *) list_nth(fdw_private,
+															FdwScanPrivateShards),
+										  festate->tree,
+										  festate->is_collection,
+										  festate->quals, branches, nquals);
+	}
+
+	/*
+	 * Conditions on the tree id restrict the scan to the files holding the
+	 * range of ids wanted, and end it at the last id wanted.
+	 */
+	festate->first_file = 0;
+	festate->last_file = festate->shard->nfiles - 1;
+	festate->range_attr = -1;
+	festate->max_id = PG_INT64_MAX;
+	{
+		int64		min_id = 0;
+		int64		max_id = PG_INT64_MAX;
+		int			nfiles = festate->shard->nfiles;
+
+		for (i = 0; i < nquals; i++)
+		{
+			if (festate->quals[i].atttype == RootTreeId)
+			{
+				narrow_tree_id_range(&festate->quals[i], &min_id, &max_id);
+				festate->range_attr = festate->quals[i].index;
+			}
+		}
+
+		if (festate->range_attr >= 0)
+		{
+			festate->max_id = max_id;
+			if (min_id > max_id || min_id >= festate->offsets[nfiles])
+			{
+				festate->last_file = -1;
+			}
+			else
+			{
+				festate->first_file = find_tree_id_file(festate->offsets,
+														nfiles, min_id);
+				festate->last_file = find_tree_id_file(festate->offsets,
+													   nfiles,
+													   Min(max_id,
+														   festate->offsets[nfiles] - 1));
+			}
+		}
+	}
+
+	/* Resolve converters of the attributes stored in the tuple */
+	festate->converters = (RootConverter *) palloc(Max(festate->nproj, 1) *
+												   sizeof(RootConverter));
+	festate->all_float = true;
+	for (i = 0; i < festate->nproj; i++)
+	{
+		RootAttributeType atttype = festate->atttypes[festate->proj[i]];
+
+		festate->converters[i] = get_root_converter(atttype);
+		if (atttype != RootFloat)
+			festate->all_float = false;
+	}
+
+	/*
+	 * Allocate batch buffers, one column per projected attribute, followed
+	 * by one per array attribute.
+	 */
+	festate->batch.nrows = 0;
+	festate->batch.next = 0;
+	festate->batch.values = (Datum **) palloc(Max(festate->nproj +
+												  festate->narrays, 1) *
+											  sizeof(Datum *));
+	for (i = 0; i < festate->nproj + festate->narrays; i++)
+	{
+		festate->batch.values[i] = (Datum *) palloc(ROOT_BATCH_SIZE *
+													sizeof(Datum));
+	}
+	festate->batch.batch_cxt =
+		AllocSetContextCreate(scan_cxt,
+							  "root_fdw batch",
+							  ALLOCSET_DEFAULT_SIZES);
+
+	/* No file is being scanned yet */
+	festate->file = -1;
+	festate->root_cursor = NULL;
+	festate->next_file = 0;
+	festate->prefetched = 0;
+	festate->pscan = NULL;
+	festate->pscan_seg = NULL;
+	festate->cursor_id = -1;
+	festate->parent = NULL;
+	festate->join_attr = -1;
+
+	/*
+	 * Files may be read from the column cache, or fill it, unless array
+	 * attributes are read along.  Scans with conditions only store the
+	 * attributes the conditions refer to, so that selective scans don't
+	 * evict the whole cache for the few entries they return.
+	 */
+	festate->use_cache = (root_column_cache != NULL && festate->narrays == 0 &&
+						  nattrs > 0);
+	festate->from_cache = false;
+	festate->filling = false;
+	if (festate->use_cache)
+	{
+		festate->cache_fill = (bool *) palloc(nattrs * sizeof(bool));
+		festate->chunk = (RootCacheValue **) palloc(nattrs *
+													sizeof(RootCacheValue *));
+		for (i = 0; i < nattrs; i++)
+		{
+			festate->cache_fill[i] = (nquals == 0);
+			festate->chunk[i] = (RootCacheValue *)
+				palloc(ROOT_CACHE_CHUNK * sizeof(RootCacheValue));
+		}
+		for (i = 0; i < nquals; i++)
+			festate->cache_fill[festate->quals[i].index] = true;
+		festate->cache_converters = (RootCacheConverter *)
+			palloc(Max(festate->nproj, 1) * sizeof(RootCacheConverter));
+	}
+
+	/* Aggregate scans return groups instead of entries */
+	festate->agg = NULL;
+	if (list_length(fdw_private) > FdwScanPrivateOutputs)
+	{
+		int64		count_only = -1;
+
+		/* count(*) is the number of tree entries when the scan starts */
+		if (intVal(list_nth(fdw_private, FdwScanPrivateCountOnly)))
+			count_only = festate->offsets[festate->shard->nfiles];
+
+		festate->agg = create_agg_state(festate,
+										(List *) list_nth(fdw_private,
+														  FdwScanPrivateOutputs),
+										count_only, scan_cxt);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return festate;
+}
+
+/*
+ * Build the state of a join between a tree table and a collection table.
+ * The scan of the collection drives the join: it claims the files, fills
+ * the batch and moves the cursor of the scan of the tree, its parent, to
+ * the tree entry of each of its entries.  Values of the parent are stored
+ * in batch columns following those of the collection.
+ */
+static RootFdwExecutionState *
+create_join_state(List *fdw_private, MemoryContext cxt)
+{
+	RootFdwExecutionState *festate;
+	RootFdwExecutionState *parent;
+	MemoryContext oldcxt;
+	int			nfiles;
+	int			i;
+
+	/* The scan of the tree lives in the context of the join */
+	festate = create_execution_state((List *) list_nth(fdw_private,
+													   FdwJoinPrivateCollection),
+									 cxt);
+	parent = create_execution_state((List *) list_nth(fdw_private,
+													  FdwJoinPrivateTree),
+									festate->scan_cxt);
+	festate->parent = parent;
+	oldcxt = MemoryContextSwitchTo(festate->scan_cxt);
+
+	festate->join_attr = find_tree_id_attr(festate);
+	parent->join_attr = find_tree_id_attr(parent);
+	if (festate->join_attr < 0 || parent->join_attr < 0)
+	{
+		elog(ERROR, "ROOT join without tree id attribute");
+	}
+
+	/*
+	 * Files and tree ids excluded by the conditions of the tree hold no
+	 * entry of the join either.
+	 */
+	nfiles = festate->shard->nfiles;
+	if (parent->skip)
+	{
+		if (festate->skip == NULL)
+			festate->skip = parent->skip;
+		else
+		{
+			for (i = 0; i < nfiles; i++)
+				festate->skip[i] = festate->skip[i] || parent->skip[i];
+		}
+	}
+	festate->first_file = Max(festate->first_file, parent->first_file);
+	festate->last_file = Min(festate->last_file, parent->last_file);
+	if (parent->range_attr >= 0)
+	{
+		festate->max_id = Min(festate->max_id, parent->max_id);
+		festate->range_attr = festate->join_attr;
+	}
+
+	/* Batch columns of the parent follow those of the collection */
+	festate->batch.values = (Datum **)
+		repalloc(festate->batch.values,
+				 Max(festate->nproj + parent->nproj, 1) * sizeof(Datum *));
+	for (i = 0; i < parent->nproj; i++)
+	{
+		festate->batch.values[festate->nproj + i] =
+			(Datum *) palloc(ROOT_BATCH_SIZE * sizeof(Datum));
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return festate;
+}
+
+/*
+ * Find the cursor attribute of the tree id in a scan, or -1 if the scan
+ * doesn't read it.
+ */
+static int
+find_tree_id_attr(RootFdwExecutionState *festate)
+{
+	int			i;
+
+	for (i = 0; i < festate->nattrs; i++)
+	{
+		if (festate->atttypes[i] == RootTreeId)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Build the state of an aggregate scan.  Each output reads its input from
+ * the batch column of the attribute it aggregates.
+ */
+static RootAggState *
+create_agg_state(RootFdwExecutionState *festate, List *outputs,
+				 int64 count_only, MemoryContext cxt)
+{
+	RootAggState *agg;
+	ListCell   *lc;
+	Size		entrysize;
+	int			i = 0;
+
+	agg = (RootAggState *) palloc0(sizeof(RootAggState));
+	agg->noutputs = list_length(outputs);
+	agg->outputs = (RootAggOutput *) palloc0(Max(agg->noutputs, 1) *
+											 sizeof(RootAggOutput));
+	agg->group = -1;
+	agg->count_only = count_only;
+
+	foreach(lc, outputs)
+	{
+		List	   *output = (List *) lfirst(lc);
+		RootAggOutput *o = &agg->outputs[i];
+		int			j;
+
+		o->kind = (RootAggKind) intVal(linitial(output));
+		o->attno = (AttrNumber) intVal(lsecond(output));
+		o->type = (Oid) intVal(lthird(output));
+		o->column = -1;
+		o->atttype = RootInvalidType;
+
+		for (j = 0; o->attno != 0 && j < festate->nproj; j++)
+		{
+			if (festate->attnos[festate->proj[j]] == o->attno)
+			{
+				o->column = j;
+				o->atttype = festate->atttypes[festate->proj[j]];
+				break;
+			}
+		}
+		if (o->column < 0 && o->kind != RootAggCount)
+		{
+			elog(ERROR, "ROOT aggregate refers to unknown attribute");
+		}
+
+		if (o->kind == RootAggGroup)
+			agg->group = i;
+		i++;
+	}
+
+	entrysize = offsetof(RootAggGroup, values) +
+		Max(agg->noutputs, 1) * sizeof(RootAggValue);
+
+	if (agg->group >= 0)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(int64);
+		ctl.entrysize = entrysize;
+		ctl.hcxt = cxt;
+		agg->groups = hash_create("root_fdw groups", 1024, &ctl,
+								  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+	else
+	{
+		agg->single = (RootAggGroup *) palloc0(entrysize);
+	}
+
+	return agg;
+}
+
+/*
+ * rootIterateForeignScan
+ *		Return next record from the current batch, refilling it from the
+ *		data files if needed, and store it into the ScanTupleSlot as a
+ *		virtual tuple
+ */
+static TupleTableSlot *
+rootIterateForeignScan(ForeignScanState *node)
+{
+	RootFdwExecutionState  *festate = (RootFdwExecutionState *) node->fdw_state;
+	TupleTableSlot 		   *slot = node->ss.ss_ScanTupleSlot;
+	Datum				   *values = slot->tts_values;
+	bool				   *nulls = slot->tts_isnull;
+	RootBatch			   *batch = &festate->batch;
+	int					   *pos = festate->pos;
+	int					   *proj = festate->proj;
+	int						nproj = festate->nproj;
+	int 					i;
+
+	if (festate->param_pending)
+		start_lookup(node, festate);
+
+	if (festate->agg)
+		return iterate_aggregate(festate, slot);
+
+	/*
+	 * The protocol for loading a virtual tuple into a slot is first
+	 * ExecClearTuple, then fill the values/isnull arrays, then
+	 * ExecStoreVirtualTuple.  If we don't find another row in the file, we
+	 * just skip the last step, leaving the slot empty as required.
+	 *
+	 * We can pass ExprContext = NULL because we read all columns from the
+	 * file, so no need to evaluate default expressions.
+	 *
+	 * We can also pass tupleOid = NULL because we don't allow oids for
+	 * foreign tables.
+	 */
+	ExecClearTuple(slot);
+
+	if (batch->next >= batch->nrows &&
+		(festate->exhausted || fill_batch(festate) == 0))
+		return slot;
+
+	/* Save values to tuple */
+	for (i = 0; i < nproj; i++)
+	{
+		int p = pos[proj[i]];
+
+		values[p] = batch->values[i][batch->next];
+		nulls[p] = false;
+	}
+
+	for (i = 0; i < festate->narrays; i++)
+	{
+		int p = festate->arrays[i].pos;
+
+		values[p] = batch->values[nproj + i][batch->next];
+		nulls[p] = false;
+	}
+
+	/* Joins also return the values of the tree entry */
+	if (festate->parent)
+	{
+		RootFdwExecutionState *parent = festate->parent;
+
+		for (i = 0; i < parent->nproj; i++)
+		{
+			int p = parent->pos[parent->proj[i]];
+
+			values[p] = batch->values[nproj + i][batch->next];
+			nulls[p] = false;
+		}
+	}
+	batch->next++;
+
+	ExecStoreVirtualTuple(slot);
+
+	return slot;
+}
+
+/*
+ * Return the next group of an aggregate scan, aggregating all entries on
+ * the first call.
+ */
+static TupleTableSlot *
+iterate_aggregate(RootFdwExecutionState *festate, TupleTableSlot *slot)
+{
+	RootAggState   *agg = festate->agg;
+	RootAggGroup   *group;
+	Datum		   *values = slot->tts_values;
+	bool		   *nulls = slot->tts_isnull;
+	int				i;
+
+	ExecClearTuple(slot);
+
+	if (!agg->done)
+	{
+		aggregate_entries(festate);
+		agg->done = true;
+	}
+
+	if (agg->emitted)
+	{
+		group = NULL;
+	}
+	else if (agg->groups)
+	{
+		if (!agg->scanning)
+		{
+			hash_seq_init(&agg->status, agg->groups);
+			agg->scanning = true;
+		}
+		group = (RootAggGroup *) hash_seq_search(&agg->status);
+		if (group == NULL)
+		{
+			agg->scanning = false;
+			agg->emitted = true;
+		}
+	}
+	else
+	{
+		group = agg->single;
+		agg->emitted = true;
+	}
+
+	if (group == NULL)
+		return slot;
+
+	/* Finalize aggregates; sum, min, max and avg of no values are null */
+	for (i = 0; i < agg->noutputs; i++)
+	{
+		RootAggOutput  *o = &agg->outputs[i];
+		RootAggValue   *v = &group->values[i];
+		bool			isfloat = o->atttype == RootFloat;
+
+		nulls[i] = false;
+		switch (o->kind)
+		{
+		case RootAggGroup:
+			if (o->type == INT4OID)
+				values[i] = Int32GetDatum((int32) group->key);
+			else
+				values[i] = Int64GetDatum(group->key);
+			break;
+		case RootAggCount:
+			values[i] = Int64GetDatum(v->count);
+			break;
+		case RootAggSum:
+		case RootAggMin:
+		case RootAggMax:
+			if (v->count == 0)
+				nulls[i] = true;
+			else if (isfloat)
+				values[i] = Float8GetDatum(v->fval);
+			else if (o->type == INT4OID)
+				values[i] = Int32GetDatum((int32) v->ival);
+			else
+				values[i] = Int64GetDatum(v->ival);
+			break;
+		case RootAggAvg:
+			if (v->count == 0)
+				nulls[i] = true;
+			else
+				values[i] = Float8GetDatum(v->fval / v->count);
+			break;
+		}
+	}
+
+	ExecStoreVirtualTuple(slot);
+
+	return slot;
+}
+
+/*
+ * Aggregate all entries of the shard that pass the conditions checked by
+ * the cursor loop, a batch at a time.  Without grouping, each aggregate is
+ * advanced over a whole batch column at once.
+ */
+static void
+aggregate_entries(RootFdwExecutionState *festate)
+{
+	RootAggState   *agg = festate->agg;
+	RootBatch	   *batch = &festate->batch;
+	int				i;
+
+	if (agg->count_only >= 0)
+	{
+		for (i = 0; i < agg->noutputs; i++)
+			agg->single->values[i].count = agg->count_only;
+		return;
+	}
+
+	while (fill_batch(festate) > 0)
+	{
+		if (agg->groups == NULL)
+		{
+			for (i = 0; i < agg->noutputs; i++)
+			{
+				RootAggOutput *o = &agg->outputs[i];
+
+				advance_agg(&agg->single->values[i], o,
+							o->column >= 0 ? batch->values[o->column] : NULL,
+							batch->nrows);
+			}
+		}
+		else
+		{
+			RootAggOutput  *key_output = &agg->outputs[agg->group];
+			Datum		   *keys = batch->values[key_output->column];
+			int				row;
+
+			for (row = 0; row < batch->nrows; row++)
+			{
+				RootAggGroup   *group;
+				int64			key;
+				bool			found;
+
+				key = root_datum_get_int64(keys[row], key_output->atttype);
+				group = (RootAggGroup *) hash_search(agg->groups, &key,
+													 HASH_ENTER, &found);
+				if (!found)
+					memset(group->values, 0,
+						   agg->noutputs * sizeof(RootAggValue));
+
+				for (i = 0; i < agg->noutputs; i++)
+				{
+					RootAggOutput *o = &agg->outputs[i];
+
+					advance_agg(&group->values[i], o,
+								o->column >= 0 ?
+								batch->values[o->column] + row : NULL,
+								1);
+				}
+			}
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	close_current_file(festate);
+}
+
+/*
+ * Advance the transition state of an aggregate over nrows values of a batch
+ * column.  Float min and max order NaNs the way float8 comparisons do.
+ */
+static void
+advance_agg(RootAggValue *value, RootAggOutput *output, Datum *column,
+			int nrows)
+{
+	bool		isfloat = output->atttype == RootFloat;
+	int			i;
+
+	switch (output->kind)
+	{
+	case RootAggGroup:
+		return;
+	case RootAggCount:
+		break;
+	case RootAggSum:
+	case RootAggAvg:
+		if (isfloat)
+		{
+			for (i = 0; i < nrows; i++)
+				value->fval += DatumGetFloat8(column[i]);
+		}
+		else
+		{
+			for (i = 0; i < nrows; i++)
+				value->ival += root_datum_get_int64(column[i],
+													output->atttype);
+		}
+		break;
+	case RootAggMin:
+	case RootAggMax:
+		for (i = 0; i < nrows; i++)
+		{
+			int			cmp;
+
+			if (isfloat)
+			{
+				double		fval = DatumGetFloat8(column[i]);
+
+				cmp = root_float_cmp(fval, value->fval);
+				if (value->count + i == 0 ||
+					(output->kind == RootAggMin ? cmp < 0 : cmp > 0))
+					value->fval = fval;
+			}
+			else
+			{
+				int64		ival = root_datum_get_int64(column[i],
+														output->atttype);
+
+				cmp = (ival > value->ival) ? 1 : ((ival < value->ival) ? -1 : 0);
+				if (value->count + i == 0 ||
+					(output->kind == RootAggMin ? cmp < 0 : cmp > 0))
+					value->ival = ival;
+			}
+		}
+		break;
+	}
+
+	value->count += nrows;
+}
+
+/*
+ * Get the value of an integer attribute stored in the batch as an int64.
+ */
+static int64
+root_datum_get_int64(Datum value, RootAttributeType atttype)
+{
+	switch (atttype)
+	{
+	case RootTreeId:
+		return DatumGetInt64(value);
+	case RootCollectionId:
+	case RootInt:
+		return DatumGetInt32(value);
+	case RootUInt:
+		return DatumGetUInt32(value);
+	case RootBool:
+		return DatumGetBool(value) ? 1 : 0;
+	default:
+		elog(ERROR, "ROOT invalid type found");
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * rootReScanForeignScan
+ *		Rescan table, possibly with new parameters
+ *
+ *		librootcursor can't rewind a cursor, so the scan starts over from
+ *		the first file and cursors are opened again, but on the ROOT
+ *		instances already opened for the files of the shard.  Results that
+ *		didn't need to touch the files again are returned from memory: the
+ *		groups of an aggregate scan, and scans that fit in a single batch.
+ */
+static void
+rootReScanForeignScan(ForeignScanState *node)
+{
+	RootFdwExecutionState *festate = (RootFdwExecutionState *) node->fdw_state;
+	RootBatch  *batch = &festate->batch;
+	RootAggState *agg = festate->agg;
+
+	if (!IsParallelWorker())
+		festate->scans++;
+
+	if (agg)
+	{
+		if (agg->scanning)
+			hash_seq_term(&agg->status);
+		agg->scanning = false;
+		agg->emitted = false;
+		return;
+	}
+
+	/*
+	 * A parallel scan hands out files again, so each participant must claim
+	 * its own files anew.
+	 */
+	if (festate->exhausted && festate->nbatches == 1 &&
+		festate->pscan == NULL && node->ss.ps.chgParam == NULL)
+	{
+		batch->next = 0;
+		return;
+	}
+
+	/* Lookups decide where to start once the new tree id is known */
+	if (festate->lookup)
+	{
+		festate->param_pending = true;
+		return;
+	}
+
+	close_current_file(festate);
+	festate->next_file = 0;
+	festate->prefetched = 0;
+	festate->nbatches = 0;
+	festate->exhausted = false;
+	batch->nrows = 0;
+	batch->next = 0;
+}
+
+/*
+ * Start looking up the tree id given by the parameter of the scan.  If the
+ * cursor is still in the file holding it and hasn't gone past it, the lookup
+ * goes on from there, so that lookups of ascending ids read each file once.
+ */
+static void
+start_lookup(ForeignScanState *node, RootFdwExecutionState *festate)
+{
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	MemoryContext oldcxt;
+	Datum		value;
+	bool		isnull;
+	int64		id = -1;
+	int			file;
+
+	oldcxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+	value = ExecEvalExpr(festate->lookup_expr, econtext, &isnull);
+	MemoryContextSwitchTo(oldcxt);
+
+	if (!isnull)
+	{
+		switch (festate->lookup_type)
+		{
+		case INT2OID:
+			id = DatumGetInt16(value);
+			break;
+		case INT4OID:
+			id = DatumGetInt32(value);
+			break;
+		default:
+			id = DatumGetInt64(value);
+			break;
+		}
+	}
+
+	file = find_tree_id_file(festate->offsets, festate->shard->nfiles, id);
+
+	festate->param_pending = false;
+	festate->lookup_id = id;
+	festate->lookup_file = file;
+
+	if (festate->root_cursor != NULL && festate->file == file &&
+		(festate->pending ? festate->cursor_id <= id : festate->cursor_id < id))
+	{
+		festate->next_file = file + 1;
+	}
+	else
+	{
+		close_current_file(festate);
+		festate->next_file = file;
+	}
+
+	festate->nbatches = 0;
+	festate->exhausted = false;
+	festate->batch.nrows = 0;
+	festate->batch.next = 0;
+}
+
+/*
+ * rootEndForeignScan
+ *		Finish scanning foreign table and dispose objects used for this scan
+ */
+static void
+rootEndForeignScan(ForeignScanState *node)
+{
+	RootFdwExecutionState *festate = (RootFdwExecutionState *) node->fdw_state;
+	close_current_file(festate);
+
+	/*
+	 * Workers of a parallel scan leave their work for the leader, which
+	 * counts it with its own.  The leader normally has the workers' counters
+	 * once the parallel scan is shut down, but a scan ending first takes
+	 * those stored by then.
+	 */
+	if (IsParallelWorker() && festate->pscan)
+		store_worker_counters(festate);
+	else
+	{
+		if (festate->pscan_seg)
+		{
+			cancel_on_dsm_detach(festate->pscan_seg, collect_worker_counters,
+								 PointerGetDatum(festate));
+			collect_worker_counters(festate->pscan_seg,
+									PointerGetDatum(festate));
+		}
+		if (!festate->explain_only)
+			record_table_stats(festate);
+	}
+
+	/* Release the state of the scan, rather than waiting for the query end */
+	MemoryContextDelete(festate->scan_cxt);
+	node->fdw_state = NULL;
+}
+
+/*
+ * rootExplainForeignScan
+ *		Show the shard, files, branches and conditions of a scan, and the
+ *		work it did under EXPLAIN ANALYZE
+ *
+ *		Reading and decompressing happen together inside the cursor, so
+ *		their time is shown as one.
+ */
+static void
+rootExplainForeignScan(ForeignScanState *node, ExplainState *es)
+{
+	RootFdwExecutionState *festate = (RootFdwExecutionState *) node->fdw_state;
+	RootFdwExecutionState *parent = festate->parent;
+	List	   *branches = NIL;
+	List	   *conditions = NIL;
+	int			nfiles = 0;
+	int			i;
+
+	if (festate->is_collection)
+		ExplainPropertyText("ROOT Tree",
+							psprintf("%s (collection)", festate->tree), es);
+	else
+		ExplainPropertyText("ROOT Tree", festate->tree, es);
+	ExplainPropertyText("ROOT Shards", describe_shards(festate->shards), es);
+
+	/* Files to scan, once the zone map and the tree id range are applied */
+	for (i = festate->first_file; i <= festate->last_file; i++)
+	{
+		if (!(festate->skip && festate->skip[i]))
+			nfiles++;
+	}
+	ExplainPropertyInteger("ROOT Files", nfiles, es);
+	ExplainPropertyInteger("ROOT Files Skipped",
+						   festate->shard->nfiles - nfiles, es);
+
+	for (i = 0; i < festate->nattrs; i++)
+		branches = lappend(branches, festate->attnames[i]);
+	for (i = 0; i < festate->narrays; i++)
+		branches = lappend(branches, festate->arrays[i].attname);
+	for (i = 0; parent && i < parent->nattrs; i++)
+		branches = lappend(branches, parent->attnames[i]);
+	ExplainPropertyList("ROOT Branches", branches, es);
+
+	for (i = 0; i < festate->nquals; i++)
+		conditions = lappend(conditions,
+							 describe_root_qual(festate, &festate->quals[i]));
+	for (i = 0; parent && i < parent->nquals; i++)
+		conditions = lappend(conditions,
+							 describe_root_qual(parent, &parent->quals[i]));
+	if (conditions != NIL)
+		ExplainPropertyList("ROOT Conditions", conditions, es);
+
+	if (festate->lookup)
+		ExplainPropertyText("ROOT Lookup",
+							festate->attnames[festate->lookup_attr], es);
+
+	if (es->analyze)
+	{
+		ExplainPropertyLong("ROOT Files Read", festate->files_read, es);
+		ExplainPropertyLong("ROOT Files From Cache", festate->files_cached, es);
+		ExplainPropertyLong("ROOT Bytes Read", festate->bytes_read, es);
+		ExplainPropertyLong("ROOT Entries Read", festate->entries_read, es);
+		ExplainPropertyLong("ROOT Entries Filtered",
+							festate->entries_filtered, es);
+
+		if (es->timing)
+		{
+			double		open_time = INSTR_TIME_GET_MILLISEC(festate->open_time);
+			double		convert_time = INSTR_TIME_GET_MILLISEC(festate->convert_time);
+			double		read_time;
+
+			read_time = INSTR_TIME_GET_MILLISEC(festate->scan_time) -
+				open_time - convert_time;
+			ExplainPropertyFloat("ROOT Open Time", open_time, 3, es);
+			ExplainPropertyFloat("ROOT Read Time", Max(read_time, 0.0), 3, es);
+			ExplainPropertyFloat("ROOT Conversion Time", convert_time, 3, es);
+		}
+	}
+}
+
+/*
+ * Describe a list of shard numbers as the 'shards' option gives them, with
+ * runs of consecutive shards as ranges.
+ */
+static char *
+describe_shards(List *shards)
+{
+	StringInfoData buf;
+	ListCell   *lc;
+	int			first = -1;
+	int			last = -1;
+
+	initStringInfo(&buf);
+	foreach(lc, shards)
+	{
+		int			shard = lfirst_int(lc);
+
+		if (first >= 0 && shard == last + 1)
+		{
+			last = shard;
+			continue;
+		}
+		if (first >= 0)
+		{
+			appendStringInfo(&buf, "%s%d", buf.len > 0 ? "," : "", first);
+			if (last > first)
+				appendStringInfo(&buf, "-%d", last);
+		}
+		first = last = shard;
+	}
+	if (first >= 0)
+	{
+		appendStringInfo(&buf, "%s%d", buf.len > 0 ? "," : "", first);
+		if (last > first)
+			appendStringInfo(&buf, "-%d", last);
+	}
+
+	return buf.data;
+}
+
+/*
+ * Describe a condition checked by the cursor loop, for EXPLAIN.
+ */
+static char *
+describe_root_qual(RootFdwExecutionState *festate, RootQual *qual)
+{
+	const char *op;
+	char	   *value;
+
+	switch (qual->strategy)
+	{
+	case BTLessStrategyNumber:
+		op = "<";
+		break;
+	case BTLessEqualStrategyNumber:
+		op = "<=";
+		break;
+	case BTEqualStrategyNumber:
+		op = "=";
+		break;
+	case BTGreaterEqualStrategyNumber:
+		op = ">=";
+		break;
+	case BTGreaterStrategyNumber:
+		op = ">";
+		break;
+	default:
+		elog(ERROR, "ROOT invalid condition found");
+		op = NULL;
+		break;
+	}
+
+	if (qual->atttype == RootFloat)
+		value = DatumGetCString(DirectFunctionCall1(float8out,
+													Float8GetDatum(qual->fval)));
+	else if (qual->atttype == RootBool)
+		value = qual->ival ? "true" : "false";
+	else
+		value = psprintf(INT64_FORMAT, qual->ival);
+
+	return psprintf("%s %s %s", festate->attnames[qual->index], op, value);
+}
+
+/*
+ * Add the work done by a scan to the counters of its table.  If the shared
+ * table is full, the work of tables not in it yet is not counted.
+ */
+static void
+record_table_stats(RootFdwExecutionState *festate)
+{
+	RootTableStatsKey key;
+	RootTableStats *stats;
+	bool		found;
+
+	if (!OidIsValid(festate->relid))
+		return;
+
+	/* Without shared memory, each backend counts the work of its scans */
+	if (root_table_stats == NULL)
+	{
+		HASHCTL		info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(RootTableStatsKey);
+		info.entrysize = sizeof(RootTableStats);
+		info.hcxt = TopMemoryContext;
+		root_table_stats = hash_create("root_fdw table stats", 64, &info,
+									   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.dbid = MyDatabaseId;
+	key.relid = festate->relid;
+
+	if (root_shared)
+		LWLockAcquire(root_shared->stats_lock, LW_EXCLUSIVE);
+
+	stats = (RootTableStats *) hash_search(root_table_stats, &key,
+										   root_shared ? HASH_ENTER_NULL :
+										   HASH_ENTER,
+										   &found);
+	if (stats)
+	{
+		if (!found)
+			memset((char *) stats + sizeof(RootTableStatsKey), 0,
+				   sizeof(RootTableStats) - sizeof(RootTableStatsKey));
+
+		stats->scans += festate->scans;
+		stats->files_read += festate->files_read;
+		stats->files_cached += festate->files_cached;
+		stats->bytes_read += festate->bytes_read;
+		stats->entries_read += festate->entries_read;
+		stats->entries_filtered += festate->entries_filtered;
+		stats->open_time += INSTR_TIME_GET_MILLISEC(festate->open_time);
+		stats->scan_time += INSTR_TIME_GET_MILLISEC(festate->scan_time);
+	}
+
+	if (root_shared)
+		LWLockRelease(root_shared->stats_lock);
+}
+
+/*
+ * Add the work done by a parallel worker to its counters in the shared
+ * state of the scan.
+ */
+static void
+store_worker_counters(RootFdwExecutionState *festate)
+{
+	RootWorkerCounters *counters;
+
+	if (ParallelWorkerNumber < 0 ||
+		ParallelWorkerNumber >= festate->pscan->nworkers)
+		return;
+
+	counters = &festate->pscan->workers[ParallelWorkerNumber];
+	counters->files_read += festate->files_read;
+	counters->files_cached += festate->files_cached;
+	counters->bytes_read += festate->bytes_read;
+	counters->entries_read += festate->entries_read;
+	counters->entries_filtered += festate->entries_filtered;
+	INSTR_TIME_ADD(counters->open_time, festate->open_time);
+	INSTR_TIME_ADD(counters->scan_time, festate->scan_time);
+	INSTR_TIME_ADD(counters->convert_time, festate->convert_time);
+}
+
+/*
+ * Add the work done by the workers of a parallel scan to the counters of
+ * the leader, before the shared state goes away.  Called when the leader
+ * detaches from the segment, once the workers are done.
+ */
+static void
+collect_worker_counters(dsm_segment *seg, Datum arg)
+{
+	RootFdwExecutionState *festate;
+	RootParallelScan pscan;
+	int			i;
+
+	festate = (RootFdwExecutionState *) DatumGetPointer(arg);
+	pscan = festate->pscan;
+
+	for (i = 0; i < pscan->nworkers; i++)
+	{
+		RootWorkerCounters *counters = &pscan->workers[i];
+
+		festate->files_read += counters->files_read;
+		festate->files_cached += counters->files_cached;
+		festate->bytes_read += counters->bytes_read;
+		festate->entries_read += counters->entries_read;
+		festate->entries_filtered += counters->entries_filtered;
+		INSTR_TIME_ADD(festate->open_time, counters->open_time);
+		INSTR_TIME_ADD(festate->scan_time, counters->scan_time);
+		INSTR_TIME_ADD(festate->convert_time, counters->convert_time);
+	}
+
+	festate->pscan = NULL;
+	festate->pscan_seg = NULL;
+}
+
+/*
+ * rootAnalyzeForeignTable
+ *		Test whether analyzing this foreign table is supported
+ */
+static bool
+rootAnalyzeForeignTable(Relation relation,
+						AcquireSampleRowsFunc *func,
+						BlockNumber *totalpages)
+{
+	RootFdwPlanState *fdw_private;
+	double		bytes;
+
+	fdw_private = get_plan_state(RelationGetRelid(relation));
+
+	/* Report the compressed size of the shard as the number of pages */
+	bytes = fdw_private->bytes;
+	*totalpages = (bytes + (BLCKSZ - 1)) / BLCKSZ;
+	if (*totalpages < 1)
+		*totalpages = 1;
+
+	*func = root_acquire_sample_rows;
+
+	return true;
+}
+
+/*
+ * rootImportForeignSchema
+ *		Generate foreign tables for the trees and collections of shards
+ *
+ *		The remote schema names the shards, as the 'shards' option does.
+ *		Branches and their types are read from the schema file of the first
+ *		shard, since librootcursor can't list the branches of a file.
+ */
+static List *
+rootImportForeignSchema(ImportForeignSchemaStmt *stmt, Oid serverOid)
+{
+	ForeignServer *server;
+	List	   *shards;
+	List	   *tables;
+	List	   *commands = NIL;
+	ListCell   *lc;
+	StringInfoData buf;
+
+	server = GetForeignServer(serverOid);
+
+	shards = parse_shard_list(stmt->remote_schema);
+	if (shards == NIL)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_SCHEMA_NOT_FOUND),
+				 errmsg("invalid shard list \"%s\" in root_fdw",
+						stmt->remote_schema),
+				 errhint("The remote schema must be a list of shard numbers or ranges, as in \"1-40,45\".")));
+	}
+
+	/* Tables must be the same in every shard the table scans */
+	tables = read_shard_schema(linitial_int(shards));
+	for_each_cell(lc, lnext(list_head(shards)))
+	{
+		char	   *detail;
+
+		detail = compare_shard_schemas(tables,
+									   read_shard_schema(lfirst_int(lc)));
+		if (detail != NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_ERROR),
+					 errmsg("schema of shard %d differs from that of shard %d",
+							lfirst_int(lc), linitial_int(shards)),
+					 errdetail("%s", detail)));
+	}
+
+	initStringInfo(&buf);
+	foreach(lc, tables)
+	{
+		RootImportTable *table = (RootImportTable *) lfirst(lc);
+		char	   *relname;
+		char	   *idname;
+		bool		listed = false;
+		ListCell   *lc2;
+		ListCell   *lc3;
+		int			i;
+
+		/* Collections are named after their tree */
+		if (table->collection)
+			relname = psprintf("%s_%s", table->tree, table->collection);
+		else
+			relname = table->tree;
+		relname = downcase_identifier(relname, strlen(relname), false, true);
+
+		foreach(lc2, stmt->table_list)
+		{
+			RangeVar   *rv = (RangeVar *) lfirst(lc2);
+
+			if (strcmp(rv->relname, relname) == 0)
+				listed = true;
+		}
+		if ((stmt->list_type == FDW_IMPORT_SCHEMA_LIMIT_TO && !listed) ||
+			(stmt->list_type == FDW_IMPORT_SCHEMA_EXCEPT && listed))
+			continue;
+
+		resetStringInfo(&buf);
+		appendStringInfo(&buf, "CREATE FOREIGN TABLE %s (\n",
+						 quote_identifier(relname));
+
+		/* Id columns implicit in the ROOT schema */
+		idname = psprintf("%s_id", table->tree);
+		appendStringInfo(&buf, "  %s bigint",
+						 quote_identifier(downcase_identifier(idname,
+															  strlen(idname),
+															  false, true)));
+		if (table->collection)
+		{
+			idname = psprintf("%s_id", table->collection);
+			appendStringInfo(&buf, ",\n  %s integer",
+							 quote_identifier(downcase_identifier(idname,
+																  strlen(idname),
+																  false, true)));
+		}
+
+		foreach(lc2, table->attrs)
+		{
+			RootAttr   *attr = (RootAttr *) lfirst(lc2);
+			const char *type;
+
+			switch (attr->atttype)
+			{
+			case RootInt:
+				type = "integer";
+				break;
+			case RootUInt:
+				type = "bigint";
+				break;
+			case RootFloat:
+				type = "double precision";
+				break;
+			case RootBool:
+				type = "boolean";
+				break;
+			default:
+				elog(ERROR, "ROOT invalid type found");
+				type = NULL;
+				break;
+			}
+
+			appendStringInfo(&buf, ",\n  %s %s%s",
+							 quote_identifier(downcase_identifier(attr->attname,
+																  strlen(attr->attname),
+																  false, true)),
+							 type, attr->isarray ? "[]" : "");
+		}
+
+		appendStringInfo(&buf, "\n) SERVER %s\nOPTIONS (shards %s, tree %s",
+						 quote_identifier(server->servername),
+						 quote_literal_cstr(stmt->remote_schema),
+						 quote_literal_cstr(table->tree));
+		if (table->collection)
+			appendStringInfo(&buf, ", collection %s",
+							 quote_literal_cstr(table->collection));
+		appendStringInfo(&buf, ", nattrs '%d'", list_length(table->attrs));
+
+		i = 0;
+		forboth(lc2, table->attrs, lc3, table->typenames)
+		{
+			RootAttr   *attr = (RootAttr *) lfirst(lc2);
+			char	   *typename = (char *) lfirst(lc3);
+
+			appendStringInfo(&buf, ", attr_%d %s", ++i,
+							 quote_literal_cstr(psprintf("%s:%s",
+														 attr->attname,
+														 typename)));
+		}
+
+		/* Declared order lets the planner skip sorts */
+		if (table->sorted_by)
+			appendStringInfo(&buf, ", sorted_by %s",
+							 quote_literal_cstr(table->sorted_by));
+		appendStringInfoString(&buf, ")");
+
+		commands = lappend(commands, pstrdup(buf.data));
+	}
+
+	return commands;
+}
+
+/*
+ * rootIsForeignScanParallelSafe
+ *		Files are opened through ROOT objects private to each backend, so the
+ *		scan can run in parallel workers
+ */
+static bool
+rootIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
+							  RangeTblEntry *rte)
+{
+	return true;
+}
+
+/*
+ * rootEstimateDSMForeignScan
+ *		Estimate space needed for the shared state of a parallel scan
+ */
+static Size
+rootEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt)
+{
+	return add_size(offsetof(RootParallelScanData, workers),
+					mul_size(pcxt->nworkers, sizeof(RootWorkerCounters)));
+}
+
+/*
+ * rootInitializeDSMForeignScan
+ *		Initialize the shared state of a parallel scan
+ *
+ *		The workers' counters are collected when the leader detaches from the
+ *		segment, which happens before EXPLAIN ANALYZE shows them.
+ */
+static void
+rootInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+							 void *coordinate)
+{
+	RootFdwExecutionState *festate = (RootFdwExecutionState *) node->fdw_state;
+	RootParallelScan pscan = (RootParallelScan) coordinate;
+
+	pg_atomic_init_u32(&pscan->next_file, 0);
+	pscan->nworkers = pcxt->nworkers;
+	memset(pscan->workers, 0, pcxt->nworkers * sizeof(RootWorkerCounters));
+	festate->pscan = pscan;
+	festate->pscan_seg = pcxt->seg;
+	on_dsm_detach(pcxt->seg, collect_worker_counters, PointerGetDatum(festate));
+}
+
+/*
+ * rootReInitializeDSMForeignScan
+ *		Reset the shared state of a parallel scan before a rescan
+ *
+ *		The workers' counters keep adding up over the rescans.
+ */
+static void
+rootReInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+							   void *coordinate)
+{
+	RootParallelScan pscan = (RootParallelScan) coordinate;
+
+	pg_atomic_write_u32(&pscan->next_file, 0);
+}
+
+/*
+ * rootInitializeWorkerForeignScan
+ *		Attach a parallel worker to the shared state of a parallel scan
+ */
+static void
+rootInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc,
+								void *coordinate)
+{
+	RootFdwExecutionState *festate = (RootFdwExecutionState *) node->fdw_state;
+
+	festate->pscan = (RootParallelScan) coordinate;
+}
+
+/*
+ * Converters from cursor attributes to Datums, one per ROOT type.
+ */
+static Datum
+convert_tree_id(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Int64GetDatum(get_tree_id(root_cursor, attr) + tree_offset);
+}
+
+static Datum
+convert_collection_id(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Int32GetDatum(get_collection_id(root_cursor, attr));
+}
+
+static Datum
+convert_int(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Int32GetDatum(get_int(root_cursor, attr));
+}
+
+static Datum
+convert_uint(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return UInt32GetDatum(get_uint(root_cursor, attr));
+}
+
+static Datum
+convert_float(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Float8GetDatum(get_float(root_cursor, attr));
+}
+
+static Datum
+convert_bool(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return BoolGetDatum(get_bool(root_cursor, attr));
+}
+
+/*
+ * Converters to other column types than the default one of a ROOT type.
+ */
+static Datum
+convert_int_to_int2(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	int32		value = get_int(root_cursor, attr);
+
+	if (value < PG_INT16_MIN || value > PG_INT16_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("smallint out of range")));
+
+	return Int16GetDatum((int16) value);
+}
+
+static Datum
+convert_int_to_int8(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Int64GetDatum((int64) get_int(root_cursor, attr));
+}
+
+static Datum
+convert_int_to_float4(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Float4GetDatum((float4) get_int(root_cursor, attr));
+}
+
+static Datum
+convert_int_to_float8(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Float8GetDatum((float8) get_int(root_cursor, attr));
+}
+
+static Datum
+convert_uint_to_int4(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	uint32		value = get_uint(root_cursor, attr);
+
+	if (value > PG_INT32_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("integer out of range")));
+
+	return Int32GetDatum((int32) value);
+}
+
+static Datum
+convert_uint_to_int8(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Int64GetDatum((int64) get_uint(root_cursor, attr));
+}
+
+static Datum
+convert_float_to_float4(RootCursor *root_cursor, int attr, int64 tree_offset)
+{
+	return Float4GetDatum((float4) get_float(root_cursor, attr));
+}
+
+/*
+ * Get converter for a ROOT type.
+ */
+static RootConverter
+get_root_converter(RootAttributeType atttype)
+{
+	switch (atttype)
+	{
+	case RootTreeId:
+		return convert_tree_id;
+	case RootCollectionId:
+		return convert_collection_id;
+	case RootInt:
+		return convert_int;
+	case RootUInt:
+		return convert_uint;
+	case RootFloat:
+		return convert_float;
+	case RootBool:
+		return convert_bool;
+	default:
+		elog(ERROR, "ROOT invalid type found");
+		break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Get converter for a ROOT type stored in a column of a given type, or NULL
+ * if the column can't hold the values of the ROOT type.  Integer branches
+ * can be read into smallint, integer, bigint, real and double precision
+ * columns, unsigned ones into integer and bigint columns and floating-point
+ * ones into real and double precision columns.
+ */
+static RootConverter
+get_column_converter(RootAttributeType atttype, Oid typid)
+{
+	switch (atttype)
+	{
+	case RootTreeId:
+		if (typid == INT8OID)
+			return convert_tree_id;
+		break;
+	case RootCollectionId:
+		if (typid == INT4OID)
+			return convert_collection_id;
+		break;
+	case RootInt:
+		if (typid == INT2OID)
+			return convert_int_to_int2;
+		if (typid == INT4OID)
+			return convert_int;
+		if (typid == INT8OID)
+			return convert_int_to_int8;
+		if (typid == FLOAT4OID)
+			return convert_int_to_float4;
+		if (typid == FLOAT8OID)
+			return convert_int_to_float8;
+		break;
+	case RootUInt:
+		if (typid == INT4OID)
+			return convert_uint_to_int4;
+		if (typid == INT8OID)
+			return convert_uint_to_int8;
+		break;
+	case RootFloat:
+		if (typid == FLOAT4OID)
+			return convert_float_to_float4;
+		if (typid == FLOAT8OID)
+			return convert_float;
+		break;
+	case RootBool:
+		if (typid == BOOLOID)
+			return convert_bool;
+		break;
+	default:
+		break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Resolve the converters of the attributes stored in the tuple from the
+ * declared types of their columns, erroring out on columns that can't hold
+ * their ROOT type.  The floats-only loop is only kept when every column is
+ * double precision.
+ */
+static void
+resolve_column_converters(RootFdwExecutionState *festate, TupleDesc tupdesc)
+{
+	int			i;
+
+	festate->all_float = true;
+	for (i = 0; i < festate->nproj; i++)
+	{
+		int			attr = festate->proj[i];
+		Form_pg_attribute column = tupdesc->attrs[festate->pos[attr]];
+
+		festate->converters[i] = get_column_converter(festate->atttypes[attr],
+													  column->atttypid);
+		if (festate->converters[i] == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
+					 errmsg("column \"%s\" of type %s cannot hold the values of branch \"%s\"",
+							NameStr(column->attname),
+							format_type_be(column->atttypid),
+							festate->attnames[attr])));
+		if (festate->converters[i] != convert_float)
+			festate->all_float = false;
+	}
+}
+
+/*
+ * Converters from values of the column cache to Datums.  Collection ids are
+ * integers as far as the cache is concerned.
+ */
+static Datum
+convert_cached_tree_id(RootCacheValue value, int64 tree_offset)
+{
+	return Int64GetDatum(value.ival + tree_offset);
+}
+
+static Datum
+convert_cached_int(RootCacheValue value, int64 tree_offset)
+{
+	return Int32GetDatum((int32) value.ival);
+}
+
+static Datum
+convert_cached_uint(RootCacheValue value, int64 tree_offset)
+{
+	return UInt32GetDatum((uint32) value.ival);
+}
+
+static Datum
+convert_cached_float(RootCacheValue value, int64 tree_offset)
+{
+	return Float8GetDatum(value.fval);
+}
+
+static Datum
+convert_cached_bool(RootCacheValue value, int64 tree_offset)
+{
+	return BoolGetDatum(value.ival != 0);
+}
+
+static Datum
+convert_cached_int_to_int2(RootCacheValue value, int64 tree_offset)
+{
+	if (value.ival < PG_INT16_MIN || value.ival > PG_INT16_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("smallint out of range")));
+
+	return Int16GetDatum((int16) value.ival);
+}
+
+static Datum
+convert_cached_int_to_int8(RootCacheValue value, int64 tree_offset)
+{
+	return Int64GetDatum(value.ival);
+}
+
+static Datum
+convert_cached_int_to_float4(RootCacheValue value, int64 tree_offset)
+{
+	return Float4GetDatum((float4) value.ival);
+}
+
+static Datum
+convert_cached_int_to_float8(RootCacheValue value, int64 tree_offset)
+{
+	return Float8GetDatum((float8) value.ival);
+}
+
+static Datum
+convert_cached_uint_to_int4(RootCacheValue value, int64 tree_offset)
+{
+	if (value.ival > PG_INT32_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("integer out of range")));
+
+	return Int32GetDatum((int32) value.ival);
+}
+
+static Datum
+convert_cached_float_to_float4(RootCacheValue value, int64 tree_offset)
+{
+	return Float4GetDatum((float4) value.fval);
+}
+
+/*
+ * Get the converter of values of the column cache matching the converter
+ * resolved for a column.
+ */
+static RootCacheConverter
+get_cached_converter(RootConverter converter)
+{
+	if (converter == convert_tree_id)
+		return convert_cached_tree_id;
+	if (converter == convert_collection_id || converter == convert_int)
+		return convert_cached_int;
+	if (converter == convert_uint)
+		return convert_cached_uint;
+	if (converter == convert_float)
+		return convert_cached_float;
+	if (converter == convert_bool)
+		return convert_cached_bool;
+	if (converter == convert_int_to_int2)
+		return convert_cached_int_to_int2;
+	if (converter == convert_int_to_int8 || converter == convert_uint_to_int8)
+		return convert_cached_int_to_int8;
+	if (converter == convert_int_to_float4)
+		return convert_cached_int_to_float4;
+	if (converter == convert_int_to_float8)
+		return convert_cached_int_to_float8;
+	if (converter == convert_uint_to_int4)
+		return convert_cached_uint_to_int4;
+	if (converter == convert_float_to_float4)
+		return convert_cached_float_to_float4;
+
+	elog(ERROR, "ROOT invalid converter found");
+	return NULL;
+}
+
+/*
+ * Refill the batch with up to ROOT_BATCH_SIZE entries that pass the
+ * conditions checked by the cursor loop, moving on to the next file whenever
+ * the current one is exhausted.  Only the payload attributes of entries that
+ * passed are read.
+ *
+ * Returns the number of buffered entries, which is zero once all files have
+ * been scanned.
+ */
+static int
+fill_batch(RootFdwExecutionState *festate)
+{
+	RootBatch	   *batch = &festate->batch;
+	RootQual	   *quals = festate->quals;
+	int				nquals = festate->nquals;
+	int			   *proj = festate->proj;
+	int				nproj = festate->nproj;
+	RootConverter  *converters = festate->converters;
+	bool			all_float = festate->all_float;
+	RootFdwExecutionState *parent = festate->parent;
+	int				nrows = 0;
+	int64			nread = 0;
+	int64			nfiltered = 0;
+	instr_time		start;
+	instr_time		convert_start;
+	instr_time		end;
+	MemoryContext	oldcxt;
+	int				i;
+
+	INSTR_TIME_SET_CURRENT(start);
+	MemoryContextReset(batch->batch_cxt);
+	oldcxt = MemoryContextSwitchTo(batch->batch_cxt);
+
+	while (nrows < ROOT_BATCH_SIZE &&
+		   (festate->file >= 0 || open_next_file(festate)))
+	{
+		RootCursor *root_cursor = festate->root_cursor;
+		int64		tree_offset = festate->offsets[festate->file];
+
+		/*
+		 * Files read from the column cache go through its chunks instead of
+		 * the cursor.  If a chunk was evicted since the file was opened, the
+		 * cursor takes over from the entry the chunk starts at.
+		 */
+		if (festate->from_cache)
+		{
+			RootCacheValue **chunk = festate->chunk;
+			int			k;
+
+			if (festate->chunk_next == festate->chunk_nvalues)
+			{
+				if (festate->chunk_last)
+					close_current_file(festate);
+				else if (!load_cached_chunk(festate,
+											(int) (festate->entry /
+												   ROOT_CACHE_CHUNK)))
+					resume_file_cursor(festate);
+				continue;
+			}
+
+			k = festate->chunk_next++;
+			festate->entry++;
+			nread++;
+
+			if (festate->range_attr >= 0 &&
+				chunk[festate->range_attr][k].ival + tree_offset >
+				festate->max_id)
+			{
+				close_current_file(festate);
+				continue;
+			}
+
+			for (i = 0; i < nquals; i++)
+			{
+				if (!root_qual_matches_value(&quals[i],
+											 chunk[quals[i].index][k],
+											 tree_offset))
+					break;
+			}
+			if (i < nquals)
+			{
+				nfiltered++;
+				CHECK_FOR_INTERRUPTS();
+				continue;
+			}
+
+			if (festate->timing)
+				INSTR_TIME_SET_CURRENT(convert_start);
+			for (i = 0; i < nproj; i++)
+				batch->values[i][nrows] =
+					festate->cache_converters[i](chunk[proj[i]][k],
+												 tree_offset);
+			if (festate->timing)
+			{
+				INSTR_TIME_SET_CURRENT(end);
+				INSTR_TIME_ACCUM_DIFF(festate->convert_time, end, convert_start);
+			}
+			nrows++;
+			continue;
+		}
+
+		/* Move on to the next file once this one is exhausted */
+		if (festate->pending)
+		{
+			festate->pending = false;
+		}
+		else if (!advance_root_cursor(root_cursor))
+		{
+			if (festate->filling)
+				flush_cached_chunk(festate, true);
+			close_current_file(festate);
+			continue;
+		}
+		else
+			nread++;
+
+		/* Record the entry for the column cache */
+		if (festate->filling)
+			fill_cached_entry(festate, root_cursor);
+
+		/*
+		 * Lookups skip entries up to the tree id wanted, and stop at the
+		 * first entry past it, which is left pending for the next lookup.
+		 */
+		if (festate->lookup)
+		{
+			int64		id;
+
+			id = get_tree_id(root_cursor, festate->lookup_attr) + tree_offset;
+			festate->cursor_id = id;
+			if (id < festate->lookup_id)
+			{
+				nfiltered++;
+				CHECK_FOR_INTERRUPTS();
+				continue;
+			}
+			if (id > festate->lookup_id)
+			{
+				festate->pending = true;
+				break;
+			}
+		}
+
+		/* No entry past the last tree id wanted can match */
+		if (festate->range_attr >= 0 &&
+			get_tree_id(root_cursor, festate->range_attr) + tree_offset >
+			festate->max_id)
+		{
+			close_current_file(festate);
+			continue;
+		}
+
+		/* Skip entries rejected by the conditions checked in the loop */
+		for (i = 0; i < nquals; i++)
+		{
+			if (!root_qual_matches(root_cursor, &quals[i], tree_offset))
+				break;
+		}
+		if (i < nquals)
+		{
+			nfiltered++;
+			CHECK_FOR_INTERRUPTS();
+			continue;
+		}
+
+		/* Joins skip entries whose tree entry is rejected */
+		if (parent &&
+			!join_tree_entry(parent, get_tree_id(root_cursor,
+												 festate->join_attr)))
+		{
+			nfiltered++;
+			CHECK_FOR_INTERRUPTS();
+			continue;
+		}
+
+		if (festate->timing)
+			INSTR_TIME_SET_CURRENT(convert_start);
+
+		/*
+		 * Save payload values to batch, now that the entry passed.
+		 * Projections made of floats only, the most common case, get a loop
+		 * of their own.
+		 */
+		if (all_float)
+		{
+			for (i = 0; i < nproj; i++)
+				batch->values[i][nrows] = Float8GetDatum(get_float(root_cursor,
+																   proj[i]));
+		}
+		else
+		{
+			for (i = 0; i < nproj; i++)
+				batch->values[i][nrows] = converters[i](root_cursor, proj[i],
+														tree_offset);
+		}
+		if (parent)
+		{
+			for (i = 0; i < parent->nproj; i++)
+				batch->values[nproj + i][nrows] =
+					parent->converters[i](parent->root_cursor,
+										  parent->proj[i], tree_offset);
+		}
+		for (i = 0; i < festate->narrays; i++)
+			batch->values[nproj + i][nrows] =
+				read_array(&festate->arrays[i],
+						   get_tree_id(root_cursor, festate->tree_attr));
+		if (festate->timing)
+		{
+			INSTR_TIME_SET_CURRENT(end);
+			INSTR_TIME_ACCUM_DIFF(festate->convert_time, end, convert_start);
+		}
+		nrows++;
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	festate->entries_read += nread;
+	festate->entries_filtered += nfiltered;
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_ACCUM_DIFF(festate->scan_time, end, start);
+
+	batch->nrows = nrows;
+	batch->next = 0;
+
+	/* A partial batch means there is nothing left to scan */
+	festate->nbatches++;
+	if (nrows < ROOT_BATCH_SIZE)
+		festate->exhausted = true;
+
+	return nrows;
+}
+
+/*
+ * Move the cursor of the tree scan of a join to the tree entry holding the
+ * collection entry being scanned, given by its tree id in the file.  Both
+ * cursors go through the file in tree id order, so the tree cursor only
+ * moves forward, and the conditions of the tree scan are checked once per
+ * tree entry.
+ *
+ * Returns true if the tree entry passes those conditions.
+ */
+static bool
+join_tree_entry(RootFdwExecutionState *tree_state, int64 id)
+{
+	RootCursor *root_cursor = tree_state->root_cursor;
+	int64		tree_offset = tree_state->offsets[tree_state->file];
+	int			i;
+
+	while (tree_state->cursor_id < id)
+	{
+		if (!advance_root_cursor(root_cursor))
+		{
+			tree_state->cursor_id = PG_INT64_MAX;
+			tree_state->join_match = false;
+			break;
+		}
+
+		tree_state->cursor_id = get_tree_id(root_cursor,
+											tree_state->join_attr);
+		for (i = 0; i < tree_state->nquals; i++)
+		{
+			if (!root_qual_matches(root_cursor, &tree_state->quals[i],
+								   tree_offset))
+				break;
+		}
+		tree_state->join_match = (i == tree_state->nquals);
+	}
+
+	return tree_state->cursor_id == id && tree_state->join_match;
+}
+
+/*
+ * Read the array of an array attribute for the tree entry given by its tree
+ * id in the file, gathering the elements of the collection entries of that
+ * tree entry.  The collection cursor goes through the file in tree id order
+ * as the tree cursor does, so it only moves forward, and the first entry of
+ * the next tree entry is left pending.
+ */
+static Datum
+read_array(RootArrayReader *reader, int64 id)
+{
+	RootCursor *root_cursor = reader->root_cursor;
+	int			nelems = 0;
+
+	for (;;)
+	{
+		if (!reader->pending)
+		{
+			if (!advance_root_cursor(root_cursor))
+				reader->cursor_id = PG_INT64_MAX;
+			else
+				reader->cursor_id = get_tree_id(root_cursor, 0);
+			reader->pending = true;
+		}
+
+		if (reader->cursor_id > id)
+			break;
+
+		if (reader->cursor_id == id)
+		{
+			if (nelems == reader->maxelems)
+			{
+				reader->maxelems *= 2;
+				reader->elems = (Datum *) repalloc(reader->elems,
+												   reader->maxelems *
+												   sizeof(Datum));
+			}
+			reader->elems[nelems++] = get_array_elem(root_cursor,
+													  reader->elemtype);
+		}
+		reader->pending = false;
+	}
+
+	if (nelems == 0)
+		return PointerGetDatum(construct_empty_array(reader->typid));
+
+	return PointerGetDatum(construct_array(reader->elems, nelems,
+										   reader->typid, reader->typlen,
+										   reader->typbyval,
+										   reader->typalign));
+}
+
+/*
+ * Get the element of an array attribute at the collection cursor.
+ */
+static Datum
+get_array_elem(RootCursor *root_cursor, RootAttributeType elemtype)
+{
+	switch (elemtype)
+	{
+	case RootInt:
+		return Int32GetDatum(get_int(root_cursor, 1));
+	case RootUInt:
+		return Int64GetDatum((int64) get_uint(root_cursor, 1));
+	case RootFloat:
+		return Float8GetDatum(get_float(root_cursor, 1));
+	case RootBool:
+		return BoolGetDatum(get_bool(root_cursor, 1));
+	default:
+		elog(ERROR, "ROOT invalid type found");
+		break;
+	}
+
+	return (Datum) 0;
+}
+
+/*
+ * Get the PostgreSQL type of the elements of an array attribute.
+ */
+static Oid
+get_array_elem_type(RootAttributeType elemtype)
+{
+	switch (elemtype)
+	{
+	case RootInt:
+		return INT4OID;
+	case RootUInt:
+		return INT8OID;
+	case RootFloat:
+		return FLOAT8OID;
+	case RootBool:
+		return BOOLOID;
+	default:
+		elog(ERROR, "ROOT invalid type found");
+		break;
+	}
+
+	return InvalidOid;
+}
+
+/*
+ * Open a cursor on the next file to scan.  In a parallel scan, the file is
+ * claimed from the counter shared by all participants.
+ *
+ * Returns false if there are no more files to scan.
+ */
+static bool
+open_next_file(RootFdwExecutionState *festate)
+{
+	int			file;
+	bool		have_stat;
+	instr_time	start;
+	instr_time	end;
+
+	close_current_file(festate);
+
+	/*
+	 * Files before the range of tree ids wanted, or excluded by the zone
+	 * map, are skipped, and files after the range end the scan.
+	 */
+	do
+	{
+		if (festate->pscan)
+			file = (int) pg_atomic_fetch_add_u32(&festate->pscan->next_file, 1);
+		else
+			file = festate->next_file++;
+	} while (file < festate->first_file ||
+			 (festate->skip && file < festate->shard->nfiles &&
+			  festate->skip[file]));
+
+	/* A lookup only reads the file holding the tree id */
+	if (file >= festate->shard->nfiles || file > festate->last_file ||
+		(festate->lookup && file != festate->lookup_file))
+		return false;
+
+	/* Let the kernel read the next files while we scan this one */
+	if (!festate->lookup)
+		prefetch_files(festate);
+
+	festate->files_read++;
+	have_stat = (stat(festate->shard->fnames[file], &festate->file_stat) == 0);
+	if (have_stat)
+		festate->bytes_read += festate->file_stat.st_size;
+
+	/*
+	 * Files whose values are all in the column cache are read from it.
+	 * Other files fill it while the cursor reads them.  Lookups and joins
+	 * need the cursor, so they leave the cache alone.
+	 */
+	if (festate->use_cache && !festate->lookup && festate->join_attr < 0 &&
+		have_stat)
+	{
+		if (open_cached_file(festate, file))
+		{
+			festate->files_cached++;
+			return true;
+		}
+		festate->filling = true;
+		festate->fill_start = 0;
+	}
+
+	INSTR_TIME_SET_CURRENT(start);
+
+	if (festate->readahead)
+		advise_file(festate->shard->fnames[file]);
+
+	open_file_cursor(festate, file);
+
+	/* Joins read the tree of the same file along with the collection */
+	if (festate->parent)
+		open_file_cursor(festate->parent, file);
+
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_ACCUM_DIFF(festate->open_time, end, start);
+
+	return true;
+}
+
+/*
+ * Start reading a file from the column cache, if the first chunk of every
+ * attribute is cached for the current version of the file.
+ */
+static bool
+open_cached_file(RootFdwExecutionState *festate, int file)
+{
+	int			i;
+
+	festate->file = file;
+	festate->entry = 0;
+	if (!load_cached_chunk(festate, 0))
+	{
+		festate->file = -1;
+		return false;
+	}
+
+	for (i = 0; i < festate->nproj; i++)
+		festate->cache_converters[i] =
+			get_cached_converter(festate->converters[i]);
+	festate->from_cache = true;
+
+	return true;
+}
+
+/*
+ * Read a chunk of the current file from the column cache, for every
+ * attribute of the scan.  The chunks must agree on the number of values,
+ * which they don't if some were stored by scans of another version of the
+ * file.
+ *
+ * Returns false if any chunk is missing.
+ */
+static bool
+load_cached_chunk(RootFdwExecutionState *festate, int chunk)
+{
+	const char *fname = festate->shard->fnames[festate->file];
+	int			nvalues = -1;
+	bool		last = false;
+	int			i;
+
+	for (i = 0; i < festate->nattrs; i++)
+	{
+		RootColumnKey key;
+		bool		attr_last = false;
+		int			n;
+
+		if (!make_column_key(&key, fname, festate->tree,
+							 festate->is_collection, festate->attnames[i],
+							 festate->atttypes[i], chunk))
+			return false;
+
+		n = get_cached_chunk(&key, &festate->file_stat, festate->chunk[i],
+							 &attr_last);
+		if (n < 0 || (i > 0 && (n != nvalues || attr_last != last)))
+			return false;
+
+		nvalues = n;
+		last = attr_last;
+	}
+
+	festate->chunk_next = 0;
+	festate->chunk_nvalues = nvalues;
+	festate->chunk_last = last;
+
+	return true;
+}
+
+/*
+ * Go on reading the current file through a cursor when its next chunk is
+ * not in the column cache anymore.  The cursor is moved past the entries
+ * already returned from the cache, and fills the cache from there on.
+ * The chunks the cache still holds, and any left half loaded, are not
+ * stored again.
+ */
+static void
+resume_file_cursor(RootFdwExecutionState *festate)
+{
+	int64		n;
+
+	festate->from_cache = false;
+	festate->filling = true;
+	festate->fill_start = festate->entry;
+
+	open_file_cursor(festate, festate->file);
+
+	for (n = 0; n < festate->entry; n++)
+	{
+		if (!advance_root_cursor(festate->root_cursor))
+		{
+			festate->filling = false;
+			break;
+		}
+		if ((n & 0xFFFF) == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Get the value of a cursor attribute as kept in the column cache.
+ */
+static RootCacheValue
+get_cache_value(RootCursor *root_cursor, int attr, RootAttributeType atttype)
+{
+	RootCacheValue value;
+
+	value.ival = 0;
+	switch (atttype)
+	{
+	case RootTreeId:
+		value.ival = get_tree_id(root_cursor, attr);
+		break;
+	case RootCollectionId:
+		value.ival = get_collection_id(root_cursor, attr);
+		break;
+	case RootInt:
+		value.ival = get_int(root_cursor, attr);
+		break;
+	case RootUInt:
+		value.ival = get_uint(root_cursor, attr);
+		break;
+	case RootFloat:
+		value.fval = get_float(root_cursor, attr);
+		break;
+	case RootBool:
+		value.ival = get_bool(root_cursor, attr) ? 1 : 0;
+		break;
+	default:
+		elog(ERROR, "ROOT invalid type found");
+		break;
+	}
+
+	return value;
+}
+
+/*
+ * Record the values of the entry the cursor is positioned on in the chunks
+ * of the current file, storing the previous chunks in the column cache once
+ * they are complete.
+ */
+static void
+fill_cached_entry(RootFdwExecutionState *festate, RootCursor *root_cursor)
+{
+	int			k = (int) (festate->entry % ROOT_CACHE_CHUNK);
+	int			i;
+
+	if (k == 0 && festate->entry > 0)
+		flush_cached_chunk(festate, false);
+
+	for (i = 0; i < festate->nattrs; i++)
+	{
+		if (festate->cache_fill[i])
+			festate->chunk[i][k] = get_cache_value(root_cursor, i,
+												   festate->atttypes[i]);
+	}
+	festate->entry++;
+}
+
+/*
+ * Store the chunk holding the last entry recorded in the column cache, if
+ * all of its entries were recorded since filling started.
+ */
+static void
+flush_cached_chunk(RootFdwExecutionState *festate, bool last)
+{
+	const char *fname = festate->shard->fnames[festate->file];
+	int			chunk;
+	int			nvalues;
+	int			i;
+
+	if (festate->entry == 0)
+		return;
+
+	chunk = (int) ((festate->entry - 1) / ROOT_CACHE_CHUNK);
+	if ((int64) chunk * ROOT_CACHE_CHUNK < festate->fill_start)
+		return;
+	nvalues = (int) (festate->entry - (int64) chunk * ROOT_CACHE_CHUNK);
+
+	for (i = 0; i < festate->nattrs; i++)
+	{
+		RootColumnKey key;
+
+		if (!festate->cache_fill[i] ||
+			!make_column_key(&key, fname, festate->tree,
+							 festate->is_collection, festate->attnames[i],
+							 festate->atttypes[i], chunk))
+			continue;
+
+		put_cached_chunk(&key, &festate->file_stat, festate->chunk[i],
+						 nvalues, last);
+	}
+}
+
+/*
+ * Open a cursor on a file of the shard, with the attributes of the scan.
+ * Cursors of the tables of a file share the ROOT instance of the file.
+ */
+static void
+open_file_cursor(RootFdwExecutionState *festate, int file)
+{
+	RootTable  *root_table;
+	RootCursor *root_cursor;
+	int			i;
+
+	root_table = get_file_table(festate->shard, file, festate->tree,
+								festate->is_collection);
+
+	/* Create ROOT cursor, keeping the file open while it is */
+	root_cursor	= init_root_cursor(root_table, festate->nattrs);
+	if (!root_cursor)
+	{
+		elog(ERROR, "failed to initialize ROOT's cursor");
+	}
+
+	/* Add attributes to cursor */
+	for (i = 0; i < festate->nattrs; i++)
+	{
+		if (!set_root_cursor_attr(root_cursor, i,
+								  festate->attnames[i], festate->atttypes[i]))
+		{
+			elog(ERROR, "failed to add attribute to ROOT cursor");
+		}
+	}
+
+	/* Open ROOT cursor */
+	if (!open_root_cursor(root_cursor))
+	{
+		elog(ERROR, "failed to open ROOT cursor");
+	}
+
+	festate->shard->files[file]->pins++;
+	festate->file = file;
+	festate->root_cursor = root_cursor;
+
+	/* Array attributes are read from the collection of the tree */
+	if (festate->narrays > 0)
+	{
+		char	   *idname = festate->attnames[festate->tree_attr];
+
+		root_table = get_file_table(festate->shard, file, festate->tree, true);
+		for (i = 0; i < festate->narrays; i++)
+		{
+			RootArrayReader *reader = &festate->arrays[i];
+
+			reader->root_cursor = init_root_cursor(root_table, 2);
+			if (!reader->root_cursor)
+			{
+				elog(ERROR, "failed to initialize ROOT's cursor");
+			}
+			if (!set_root_cursor_attr(reader->root_cursor, 0, idname,
+									  RootTreeId) ||
+				!set_root_cursor_attr(reader->root_cursor, 1,
+									  reader->attname, reader->elemtype))
+			{
+				elog(ERROR, "failed to add attribute to ROOT cursor");
+			}
+			if (!open_root_cursor(reader->root_cursor))
+			{
+				elog(ERROR, "failed to open ROOT cursor");
+			}
+			reader->cursor_id = -1;
+			reader->pending = false;
+		}
+	}
+}
+
+/*
+ * Close the cursor on the file being scanned, if any.
+ */
+static void
+close_current_file(RootFdwExecutionState *festate)
+{
+	int			i;
+
+	if (festate->root_cursor)
+	{
+		fini_root_cursor(festate->root_cursor);
+		festate->root_cursor = NULL;
+		if (festate->shard->files[festate->file]->pins > 0)
+			festate->shard->files[festate->file]->pins--;
+	}
+	for (i = 0; i < festate->narrays; i++)
+	{
+		if (festate->arrays[i].root_cursor)
+		{
+			fini_root_cursor(festate->arrays[i].root_cursor);
+			festate->arrays[i].root_cursor = NULL;
+		}
+	}
+	festate->file = -1;
+	festate->cursor_id = -1;
+	festate->pending = false;
+	festate->from_cache = false;
+	festate->filling = false;
+
+	if (festate->parent)
+		close_current_file(festate->parent);
+}
+
+/*
+ * Ask the kernel to read ahead the next root_fdw.prefetch_files files the
+ * scan will open, so that I/O for them overlaps with decompressing the
+ * current one.  Files excluded by the zone map or past the range of tree
+ * ids wanted are passed over.
+ *
+ * In a parallel scan the next file to be claimed by any participant is
+ * prefetched, as it benefits the whole scan.  Each backend remembers how far
+ * it prefetched, so files are only advised once.
+ */
+static void
+prefetch_files(RootFdwExecutionState *festate)
+{
+	int			first;
+	int			last;
+	int			nfiles = 0;
+	int			i;
+
+	if (RootPrefetchFiles <= 0)
+		return;
+
+	if (festate->pscan)
+		first = (int) pg_atomic_read_u32(&festate->pscan->next_file);
+	else
+		first = festate->next_file;
+
+	last = Min(festate->last_file, festate->shard->nfiles - 1);
+	for (i = Max(first, festate->first_file); i <= last && nfiles < RootPrefetchFiles; i++)
+	{
+		if (festate->skip && festate->skip[i])
+			continue;
+		nfiles++;
+		if (i >= festate->prefetched)
+			advise_file(festate->shard->fnames[i]);
+	}
+	festate->prefetched = Max(festate->prefetched, i);
+}
+
+/*
+ * Hint the kernel to read a whole file, for the io_mode 'readahead' option
+ * and for prefetching.  librootcursor still reads the file through its own
+ * file access, so this only gets the file into the page cache ahead of the
+ * cursor.
+ */
+static void
+advise_file(const char *fname)
+{
+#ifdef USE_PREFETCH
+	int			fd;
+
+	fd = open(fname, O_RDONLY | PG_BINARY, 0);
+	if (fd < 0)
+		return;
+	(void) posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+#endif							/* USE_PREFETCH */
+}
+
+/*
+ * Collect all attributes needed by query.
+ *
+ * The attributes collected are those needed by joins, final output or used by
+ * restriction clauses.  They are split in two sets: "predicate" attributes,
+ * used by the conditions checked in the cursor loop, come first in the list,
+ * followed by "payload" attributes, which are only read for entries that pass
+ * those conditions.  Predicate attributes that are not needed otherwise have
+ * their position set to -1 so they are never stored in the tuple.
+ */
+static List
+*collect_attributes(RelOptInfo *baserel, RootFdwPlanState *fdw_private,
+					Oid foreigntableid)
+{
+	bool		has_wholerow = false;
+	ListCell   *lc;
+	Bitmapset  *attrs_used = NULL;
+	Bitmapset  *attrs_pred = NULL;
+	Relation	rel;
+	TupleDesc	tupdesc;
+	List	   *pred_attrs = NIL;
+	List	   *payload_attrs = NIL;
+	int			i;
+	QueryAttr	*qattr;
+	RootAttr	*rattr;
+
+	/* Collect all the attributes needed for joins or final output. */
+	pull_varattnos((Node *) baserel->reltarget->exprs, baserel->relid,
+				   &attrs_used);
+
+	/* Add all the attributes used by conditions left to the executor. */
+	foreach(lc, fdw_private->local_conds)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		pull_varattnos((Node *) rinfo->clause, baserel->relid,
+					   &attrs_used);
+	}
+
+	/* Collect all the attributes used by conditions checked in the loop. */
+	foreach(lc, fdw_private->remote_conds)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		pull_varattnos((Node *) rinfo->clause, baserel->relid,
+					   &attrs_pred);
+	}
+
+	/* If there's a whole-row reference, we'll need all the columns. */
+	has_wholerow = bms_is_member(0 - FirstLowInvalidHeapAttributeNumber,
+								 attrs_used);
+
+	/* Build Lists with attribute numbers. */
+	rel = heap_open(foreigntableid, AccessShareLock);
+	tupdesc = RelationGetDescr(rel);
+	for (i = 1; i <= tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i - 1];
+		bool		is_used;
+		bool		is_pred;
+
+		/* Ignore dropped attributes. */
+		if (attr->attisdropped)
+			continue;
+
+		is_used = has_wholerow ||
+			bms_is_member(i - FirstLowInvalidHeapAttributeNumber, attrs_used);
+		is_pred = bms_is_member(i - FirstLowInvalidHeapAttributeNumber,
+								attrs_pred);
+
+		if (!is_used && !is_pred)
+			continue;
+
+		/*
+		 * Find requested attribute in the set of attributes given as
+		 * options in the table.
+		 */
+		rattr = get_root_attr(fdw_private, attr->attnum);
+		if (rattr == NULL)
+		{
+			elog(ERROR,
+				"Failed to retrieve ROOT attribute %s in ROOT schema",
+				attr->attname.data);
+		}
+
+		qattr = (QueryAttr *) palloc(sizeof(QueryAttr));
+		qattr->attr = rattr;
+		qattr->attno = attr->attnum;
+		qattr->pos = is_used ? attr->attnum - 1 : -1;
+
+		if (is_pred)
+			pred_attrs = lappend(pred_attrs, qattr);
+		else
+			payload_attrs = lappend(payload_attrs, qattr);
+	}
+	heap_close(rel, AccessShareLock);
+
+	return list_concat(pred_attrs, payload_attrs);
+}
+
+/*
+ * Find attribute in the ROOT schema given as options in the table.
+ *
+ * Returns NULL if there is no such attribute.
+ */
+static RootAttr *
+find_root_attr(List *schema, const char *attname)
+{
+	ListCell   *lc;
+
+	foreach(lc, schema)
+	{
+		RootAttr *rattr = (RootAttr *) lfirst(lc);
+
+		if (strcasecmp(rattr->attname, attname) == 0)
+			return rattr;
+	}
+
+	return NULL;
+}
+
+/*
+ * Get the ROOT attribute of a column of the table.
+ *
+ * Returns NULL if the column isn't in the ROOT schema.
+ */
+static RootAttr *
+get_root_attr(RootFdwPlanState *fdw_private, AttrNumber attno)
+{
+	if (attno < 1 || attno > fdw_private->ncolumns)
+		return NULL;
+
+	return fdw_private->columns[attno - 1];
+}
+
+/*
+ * Split baserestrictinfo into conditions that can be checked by the cursor
+ * loop in rootIterateForeignScan (remote_conds) and conditions that must be
+ * left to the executor (local_conds).
+ *
+ * A condition is pushable when build_root_qual understands its shape and the
+ * ROOT type of the column matches the kind of constant it is compared with.
+ */
+static void
+classify_conditions(RelOptInfo *baserel, RootFdwPlanState *fdw_private,
+					Oid foreigntableid)
+{
+	ListCell   *lc;
+
+	fdw_private->remote_conds = NIL;
+	fdw_private->local_conds = NIL;
+
+	foreach(lc, baserel->baserestrictinfo)
+	{
+		RestrictInfo   *rinfo = (RestrictInfo *) lfirst(lc);
+		RootQual		qual;
+		RootAttr	   *rattr = NULL;
+		bool			pushable = false;
+
+		if (!rinfo->pseudoconstant &&
+			build_root_qual(rinfo->clause, baserel->relid, &qual))
+			rattr = get_root_attr(fdw_private, qual.attno);
+
+		if (rattr != NULL && !rattr->isarray)
+		{
+			switch (rattr->atttype)
+			{
+			case RootTreeId:
+			case RootCollectionId:
+			case RootInt:
+			case RootUInt:
+				pushable = !qual.isfloat;
+				break;
+			case RootFloat:
+				pushable = qual.isfloat;
+				break;
+			case RootBool:
+				pushable = !qual.isfloat && qual.strategy == BTEqualStrategyNumber;
+				break;
+			default:
+				break;
+			}
+		}
+
+		if (pushable)
+			fdw_private->remote_conds = lappend(fdw_private->remote_conds, rinfo);
+		else
+			fdw_private->local_conds = lappend(fdw_private->local_conds, rinfo);
+	}
+}
+
+/*
+ * Is this a plain column of the scanned relation?  A relid of 0 accepts
+ * columns of any relation.
+ */
+static bool
+is_root_column(Node *node, Index relid)
+{
+	Var		   *var = (Var *) node;
+
+	return node != NULL && IsA(node, Var) &&
+		(relid == 0 || var->varno == relid) &&
+		var->varlevelsup == 0 &&
+		var->varattno > 0;
+}
+
+/*
+ * Translate a restriction clause into a RootQual.
+ *
+ * The supported shapes are "column op constant" and "constant op column" for
+ * the btree comparison operators (=, <, <=, >, >=, hence also BETWEEN) of
+ * integer, double precision and boolean columns, plus bare boolean columns,
+ * their negation and IS [NOT] TRUE/FALSE tests.  ROOT values are never null,
+ * so IS NOT TRUE is the same as IS FALSE.  Real columns are left to the
+ * executor: conditions and zones see the double the branch holds, not the
+ * value rounded to float4 that the column shows.
+ *
+ * Returns false if the clause can't be translated.
+ */
+static bool
+build_root_qual(Expr *clause, Index relid, RootQual *qual)
+{
+	Var		   *var;
+	Const	   *cnst;
+	bool		commuted = false;
+	Oid			opfamily;
+	int			strategy;
+
+	memset(qual, 0, sizeof(RootQual));
+
+	/* Bare boolean column */
+	if (is_root_column((Node *) clause, relid))
+	{
+		var = (Var *) clause;
+		if (var->vartype != BOOLOID)
+			return false;
+
+		qual->attno = var->varattno;
+		qual->strategy = BTEqualStrategyNumber;
+		qual->ival = 1;
+		return true;
+	}
+
+	/* Negated boolean column */
+	if (IsA(clause, BoolExpr) && ((BoolExpr *) clause)->boolop == NOT_EXPR)
+	{
+		Node	   *arg = (Node *) linitial(((BoolExpr *) clause)->args);
+
+		if (!is_root_column(arg, relid) || ((Var *) arg)->vartype != BOOLOID)
+			return false;
+
+		qual->attno = ((Var *) arg)->varattno;
+		qual->strategy = BTEqualStrategyNumber;
+		qual->ival = 0;
+		return true;
+	}
+
+	/* IS [NOT] TRUE/FALSE on a boolean column */
+	if (IsA(clause, BooleanTest))
+	{
+		BooleanTest *btest = (BooleanTest *) clause;
+
+		if (!is_root_column((Node *) btest->arg, relid) ||
+			((Var *) btest->arg)->vartype != BOOLOID)
+			return false;
+
+		qual->attno = ((Var *) btest->arg)->varattno;
+		qual->strategy = BTEqualStrategyNumber;
+		switch (btest->booltesttype)
+		{
+		case IS_TRUE:
+		case IS_NOT_FALSE:
+			qual->ival = 1;
+			return true;
+		case IS_FALSE:
+		case IS_NOT_TRUE:
+			qual->ival = 0;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	/* Comparison between a column and a constant */
+	if (!IsA(clause, OpExpr) || list_length(((OpExpr *) clause)->args) != 2)
+		return false;
+
+	var = (Var *) linitial(((OpExpr *) clause)->args);
+	cnst = (Const *) lsecond(((OpExpr *) clause)->args);
+	if (IsA(var, Const))
+	{
+		var = (Var *) lsecond(((OpExpr *) clause)->args);
+		cnst = (Const *) linitial(((OpExpr *) clause)->args);
+		commuted = true;
+	}
+
+	if (!is_root_column((Node *) var, relid) ||
+		!IsA(cnst, Const) || cnst->constisnull)
+		return false;
+
+	switch (var->vartype)
+	{
+	case INT2OID:
+	case INT4OID:
+	case INT8OID:
+	case FLOAT8OID:
+	case BOOLOID:
+		break;
+	default:
+		return false;
+	}
+
+	/* The operator must be a comparison of the column's btree family */
+	opfamily = get_opclass_family(GetDefaultOpClass(var->vartype,
+													BTREE_AM_OID));
+	strategy = get_op_opfamily_strategy(((OpExpr *) clause)->opno, opfamily);
+	if (strategy == 0)
+		return false;
+
+	if (commuted)
+	{
+		switch (strategy)
+		{
+		case BTLessStrategyNumber:
+			strategy = BTGreaterStrategyNumber;
+			break;
+		case BTLessEqualStrategyNumber:
+			strategy = BTGreaterEqualStrategyNumber;
+			break;
+		case BTGreaterEqualStrategyNumber:
+			strategy = BTLessEqualStrategyNumber;
+			break;
+		case BTGreaterStrategyNumber:
+			strategy = BTLessStrategyNumber;
+			break;
+		default:
+			break;
+		}
+	}
+
+	qual->attno = var->varattno;
+	qual->strategy = strategy;
+
+	switch (cnst->consttype)
+	{
+	case INT2OID:
+		qual->ival = DatumGetInt16(cnst->constvalue);
+		break;
+	case INT4OID:
+		qual->ival = DatumGetInt32(cnst->constvalue);
+		break;
+	case INT8OID:
+		qual->ival = DatumGetInt64(cnst->constvalue);
+		break;
+	case FLOAT4OID:
+		qual->isfloat = true;
+		qual->fval = DatumGetFloat4(cnst->constvalue);
+		break;
+	case FLOAT8OID:
+		qual->isfloat = true;
+		qual->fval = DatumGetFloat8(cnst->constvalue);
+		break;
+	case BOOLOID:
+		qual->ival = DatumGetBool(cnst->constvalue) ? 1 : 0;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Compare two floats the same way float8 btree comparisons do, that is,
+ * NaNs are equal to each other and greater than any other value.
+ */
+static int
+root_float_cmp(double a, double b)
+{
+	if (isnan(a))
+		return isnan(b) ? 0 : 1;
+	if (isnan(b))
+		return -1;
+	return (a > b) ? 1 : ((a < b) ? -1 : 0);
+}
+
+/*
+ * Narrow the range [min_id, max_id] of tree ids to those a condition on the
+ * tree id accepts.
+ */
+static void
+narrow_tree_id_range(RootQual *qual, int64 *min_id, int64 *max_id)
+{
+	switch (qual->strategy)
+	{
+	case BTLessStrategyNumber:
+		if (qual->ival == PG_INT64_MIN)
+			*min_id = PG_INT64_MAX;
+		else
+			*max_id = Min(*max_id, qual->ival - 1);
+		break;
+	case BTLessEqualStrategyNumber:
+		*max_id = Min(*max_id, qual->ival);
+		break;
+	case BTEqualStrategyNumber:
+		*min_id = Max(*min_id, qual->ival);
+		*max_id = Min(*max_id, qual->ival);
+		break;
+	case BTGreaterEqualStrategyNumber:
+		*min_id = Max(*min_id, qual->ival);
+		break;
+	case BTGreaterStrategyNumber:
+		if (qual->ival == PG_INT64_MAX)
+			*max_id = -1;
+		else
+			*min_id = Max(*min_id, qual->ival + 1);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Find the file holding a tree id, given the first tree id of each file and
+ * their total in offsets[nfiles].  Returns nfiles if no file holds it.
+ */
+static int
+find_tree_id_file(int64 *offsets, int nfiles, int64 id)
+{
+	int			lo = 0;
+	int			hi = nfiles - 1;
+
+	if (nfiles == 0 || id < offsets[0] || id >= offsets[nfiles])
+		return nfiles;
+
+	/* Last file whose first tree id is not past id */
+	while (lo < hi)
+	{
+		int			mid = (lo + hi + 1) / 2;
+
+		if (offsets[mid] <= id)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+/*
+ * Check a condition against the entry the cursor is positioned on.  Tree ids
+ * are offset by the first tree id of the file being scanned.
+ */
+static bool
+root_qual_matches(RootCursor *root_cursor, RootQual *qual, int64 tree_offset)
+{
+	int64		ival = 0;
+
+	switch (qual->atttype)
+	{
+	case RootTreeId:
+		ival = get_tree_id(root_cursor, qual->index) + tree_offset;
+		break;
+	case RootCollectionId:
+		ival = get_collection_id(root_cursor, qual->index);
+		break;
+	case RootInt:
+		ival = get_int(root_cursor, qual->index);
+		break;
+	case RootUInt:
+		ival = get_uint(root_cursor, qual->index);
+		break;
+	case RootBool:
+		ival = get_bool(root_cursor, qual->index) ? 1 : 0;
+		break;
+	case RootFloat:
+		return root_qual_holds(qual, 0, get_float(root_cursor, qual->index));
+	default:
+		elog(ERROR, "ROOT invalid type found");
+		break;
+	}
+
+	return root_qual_holds(qual, ival, 0.0);
+}
+
+/*
+ * Check a condition against a value read from the column cache.
+ */
+static bool
+root_qual_matches_value(RootQual *qual, RootCacheValue value,
+						int64 tree_offset)
+{
+	if (qual->atttype == RootFloat)
+		return root_qual_holds(qual, 0, value.fval);
+	if (qual->atttype == RootTreeId)
+		return root_qual_holds(qual, value.ival + tree_offset, 0.0);
+
+	return root_qual_holds(qual, value.ival, 0.0);
+}
+
+/*
+ * Check a condition against a value, given as an integer or a double
+ * depending on the type of its attribute.
+ */
+static bool
+root_qual_holds(RootQual *qual, int64 ival, double fval)
+{
+	int			cmp;
+
+	if (qual->atttype == RootFloat)
+		cmp = root_float_cmp(fval, qual->fval);
+	else
+		cmp = (ival > qual->ival) ? 1 : ((ival < qual->ival) ? -1 : 0);
+
+	switch (qual->strategy)
+	{
+	case BTLessStrategyNumber:
+		return cmp < 0;
+	case BTLessEqualStrategyNumber:
+		return cmp <= 0;
+	case BTEqualStrategyNumber:
+		return cmp == 0;
+	case BTGreaterEqualStrategyNumber:
+		return cmp >= 0;
+	case BTGreaterStrategyNumber:
+		return cmp > 0;
+	default:
+		elog(ERROR, "ROOT invalid condition found");
+		break;
+	}
+
+	return false;
+}
+
+/*
+ * Acquire a random sample of rows from a foreign table for ANALYZE.
+ *
+ * Selected rows are returned in the caller-allocated array rows[], which must
+ * have at least targrows entries.  The actual number of rows selected is
+ * returned as the function result.  We also count the total number of
+ * entries in the shard and return it into *totalrows.  ROOT files have no
+ * dead rows, so *totaldeadrows is always set to 0.
+ *
+ * Every entry of every file of the shard is read through a cursor with all
+ * columns of the table, and a reservoir sample is kept, as in file_fdw.
+ * Note that the returned list of rows is not always in order by physical
+ * position in the file.  Therefore, correlation estimates derived later may
+ * be meaningless, but it's OK because we don't use the estimates currently
+ * (the planner only pays attention to correlation for indexscans).
+ */
+static int
+root_acquire_sample_rows(Relation onerel, int elevel,
+						 HeapTuple *rows, int targrows,
+						 double *totalrows, double *totaldeadrows)
+{
+	TupleDesc	tupDesc = RelationGetDescr(onerel);
+	RootFdwPlanState	   *fdw_private;
+	RootFdwExecutionState  *festate;
+	RootBatch			   *batch;
+	List	   *attrs = NIL;
+	Datum	   *values;
+	bool	   *nulls;
+	int			numrows = 0;
+	double		rowstoskip = -1;	/* -1 means not set yet */
+	ReservoirStateData rstate;
+	int			i;
+
+	fdw_private = get_plan_state(RelationGetRelid(onerel));
+
+	/* Read every column of the table, storing it at its position */
+	for (i = 1; i <= tupDesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupDesc->attrs[i - 1];
+		RootAttr   *rattr;
+
+		if (attr->attisdropped)
+			continue;
+
+		rattr = get_root_attr(fdw_private, attr->attnum);
+		if (rattr == NULL)
+		{
+			elog(ERROR,
+				"Failed to retrieve ROOT attribute %s in ROOT schema",
+				NameStr(attr->attname));
+		}
+
+		attrs = lappend(attrs,
+						lappend(list_make4(makeString(rattr->attname),
+										   makeInteger(rattr->atttype),
+										   makeInteger(i),
+										   makeInteger(i - 1)),
+								makeInteger(rattr->isarray)));
+	}
+
+	festate = create_execution_state(build_scan_private(fdw_private, attrs,
+														NIL),
+									 CurrentMemoryContext);
+	resolve_column_converters(festate, tupDesc);
+	batch = &festate->batch;
+
+	values = (Datum *) palloc(tupDesc->natts * sizeof(Datum));
+	nulls = (bool *) palloc(tupDesc->natts * sizeof(bool));
+	memset(nulls, true, tupDesc->natts * sizeof(bool));
+
+	*totalrows = 0;
+	*totaldeadrows = 0;
+
+	/* Prepare for sampling rows */
+	reservoir_init_selection_state(&rstate, targrows);
+
+	while (fill_batch(festate) > 0)
+	{
+		int			row;
+
+		/* Check for user-requested abort or sleep */
+		vacuum_delay_point();
+
+		for (row = 0; row < batch->nrows; row++)
+		{
+			for (i = 0; i < festate->nproj; i++)
+			{
+				int p = festate->pos[festate->proj[i]];
+
+				values[p] = batch->values[i][row];
+				nulls[p] = false;
+			}
+			for (i = 0; i < festate->narrays; i++)
+			{
+				int p = festate->arrays[i].pos;
+
+				values[p] = batch->values[festate->nproj + i][row];
+				nulls[p] = false;
+			}
+
+			/*
+			 * The first targrows sample rows are simply copied into the
+			 * reservoir.  Then we start replacing tuples in the sample until
+			 * we reach the end of the relation.  This algorithm is from Jeff
+			 * Vitter's paper (see more info in commands/analyze.c).
+			 */
+			if (numrows < targrows)
+			{
+				rows[numrows++] = heap_form_tuple(tupDesc, values, nulls);
+			}
+			else
+			{
+				/*
+				 * t in Vitter's paper is the number of records already
+				 * processed.  If we need to compute a new S value, we must
+				 * use the not-yet-incremented value of totalrows as t.
+				 */
+				if (rowstoskip < 0)
+					rowstoskip = reservoir_get_next_S(&rstate, *totalrows,
+													  targrows);
+
+				if (rowstoskip <= 0)
+				{
+					/*
+					 * Found a suitable tuple, so save it, replacing one old
+					 * tuple at random
+					 */
+					int			k = (int) (targrows * sampler_random_fract(rstate.randstate));
+
+					Assert(k >= 0 && k < targrows);
+					heap_freetuple(rows[k]);
+					rows[k] = heap_form_tuple(tupDesc, values, nulls);
+				}
+
+				rowstoskip -= 1;
+			}
+
+			*totalrows += 1;
+		}
+	}
+
+	close_current_file(festate);
+	MemoryContextDelete(festate->scan_cxt);
+
+	/*
+	 * Emit some interesting relation info
+	 */
+	ereport(elevel,
+			(errmsg("\"%s\": scanned %.0f entries of %d files; "
+					"%d rows in sample",
+					RelationGetRelationName(onerel),
+					*totalrows, fdw_private->nfiles, numrows)));
+
+	return numrows;
+}
+
+/*
+ * Estimate size of a foreign table.
+ *
+ * The main result is returned in baserel->rows.  We also set
+ * fdw_private->pages and fdw_private->ntuples, scaled to the part of the
+ * shard actually read, for later use in the cost calculation.
+ */
+static void
+estimate_size(PlannerInfo *root, RelOptInfo *baserel,
+			  RootFdwPlanState *fdw_private)
+{
+	BlockNumber pages;
+	double		ntuples;
+	double		nrows;
+	double		fsize;
+	double		fraction = 1.0;
+	double	   *entries;
+	int64		min_id = 0;
+	int64		max_id = PG_INT64_MAX;
+	bool		has_range = false;
+	RootQual   *quals;
+	char	  **branches;
+	bool	   *skip;
+	int			nquals = 0;
+	ListCell   *lc;
+	int			i;
+
+	/* Get size estimate from ROOT, summing up the files of the shard. */
+	ntuples = 0;
+	entries = fdw_private->entries;
+	for (i = 0; i < fdw_private->nfiles; i++)
+		ntuples += entries[i];
+
+	/*
+	 * Convert the compressed size of the files of the shard to an estimate
+	 * of the I/O cost.
+	 */
+	fsize = fdw_private->bytes;
+	pages = (fsize + (BLCKSZ - 1)) / BLCKSZ;
+	if (pages < 1)
+		pages = 1;
+
+	/*
+	 * Now estimate the number of rows returned by the scan after applying the
+	 * baserestrictinfo quals.
+	 */
+	nrows = ntuples *
+		clauselist_selectivity(root,
+							   baserel->baserestrictinfo,
+							   0,
+							   JOIN_INNER,
+							   NULL);
+
+	nrows = clamp_row_est(nrows);
+
+	/* Save the output-rows estimate for the planner */
+	baserel->rows = nrows;
+
+	/*
+	 * Conditions on the tree id limit the scan to the entries from the start
+	 * of the file holding the first id wanted to the last id wanted, so only
+	 * that share of the shard is costed.  Files excluded by the zone map
+	 * are not costed either.
+	 */
+	quals = (RootQual *) palloc(Max(list_length(fdw_private->remote_conds), 1) *
+								sizeof(RootQual));
+	branches = (char **) palloc(Max(list_length(fdw_private->remote_conds), 1) *
+								sizeof(char *));
+	foreach(lc, fdw_private->remote_conds)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		RootQual   *qual = &quals[nquals];
+		RootAttr   *rattr;
+
+		if (!build_root_qual(rinfo->clause, baserel->relid, qual))
+			continue;
+
+		if (qual->attno == fdw_private->tree_attno)
+		{
+			narrow_tree_id_range(qual, &min_id, &max_id);
+			has_range = true;
+		}
+
+		rattr = get_root_attr(fdw_private, qual->attno);
+		if (rattr == NULL)
+			continue;
+		qual->atttype = rattr->atttype;
+		branches[nquals++] = rattr->attname;
+	}
+
+	skip = get_skipped_files(fdw_private->shards, fdw_private->tree,
+							 fdw_private->is_collection, quals, branches,
+							 nquals);
+	if (skip != NULL && ntuples > 0)
+	{
+		double		kept = 0;
+
+		for (i = 0; i < fdw_private->nfiles; i++)
+		{
+			if (!skip[i])
+				kept += entries[i];
+		}
+		fraction = kept / ntuples;
+	}
+
+	if (has_range)
+	{
+		int			nfiles = list_length(fdw_private->offsets) - 1;
+		int64	   *offsets = (int64 *) palloc((nfiles + 1) * sizeof(int64));
+		int64		total;
+
+		i = 0;
+		foreach(lc, fdw_private->offsets)
+			offsets[i++] = intVal(lfirst(lc));
+		total = offsets[nfiles];
+
+		if (min_id > max_id || min_id >= total)
+			fraction = 0;
+		else if (total > 0)
+			fraction *= (double) (Min(max_id, total - 1) + 1 -
+								  offsets[find_tree_id_file(offsets, nfiles,
+															min_id)]) / total;
+	}
+
+	fdw_private->ntuples = ntuples * fraction;
+	fdw_private->pages = Max(ceil(pages * fraction), 1);
+}
+
+/*
+ * Estimate costs of scanning a foreign table.
+ *
+ * Results are returned in *startup_cost and *total_cost.
+ */
+static void
+estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
+			   RootFdwPlanState *fdw_private, List *attrs,
+			   double parallel_divisor,
+			   Cost *startup_cost, Cost *total_cost)
+{
+	double		pages;
+	double		width;
+	double		ntuples = fdw_private->ntuples;
+	Cost		run_cost = 0;
+	Cost		cpu_run_cost;
+	Cost		cpu_per_tuple;
+
+	/* Only the branches read by the query are read and decompressed */
+	estimate_read_size(fdw_private, attrs, &pages, &width);
+
+	/*
+	 * We estimate costs almost the same way as cost_seqscan(), thus assuming
+	 * that I/O costs are equivalent to a regular table file of the same size
+	 * as the branches read.  However, we take per-tuple CPU costs as 1.5x of
+	 * a seqscan, to account for the cost of moving data from ROOT to
+	 * PostgreSQL tuples, and add the cost of decompressing the values read.
+	 * In a parallel scan, the CPU costs are spread over all participants.
 	 */
 	run_cost += seq_page_cost * pages;
 
 	*startup_cost = baserel->baserestrictcost.startup;
 	cpu_per_tuple = cpu_tuple_cost * 1.5 + baserel->baserestrictcost.per_tuple;
-	run_cost += cpu_per_tuple * ntuples;
+	cpu_per_tuple += cpu_operator_cost * ROOT_DECOMPRESSION_COST * width;
+	cpu_run_cost = cpu_per_tuple * ntuples;
+	run_cost += cpu_run_cost / parallel_divisor;
 	*total_cost = *startup_cost + run_cost;
 }
+
+/*
+ * Estimate the number of pages read and the uncompressed width per entry of
+ * the branches read by a scan.
+ *
+ * librootcursor doesn't report the size of each branch, so the compressed
+ * size of the shard is apportioned to branches by the width of their values.
+ * Tree and collection ids are derived from entry numbers and read nothing.
+ */
+static void
+estimate_read_size(RootFdwPlanState *fdw_private, List *attrs,
+				   double *pages, double *width)
+{
+	double		schema_width = 0;
+	ListCell   *lc;
+
+	*width = 0;
+
+	foreach(lc, fdw_private->schema)
+	{
+		RootAttr *rattr = (RootAttr *) lfirst(lc);
+
+		schema_width += root_type_width(rattr->atttype);
+	}
+
+	foreach(lc, attrs)
+	{
+		QueryAttr *qattr = (QueryAttr *) lfirst(lc);
+
+		*width += root_type_width(qattr->attr->atttype);
+	}
+
+	if (schema_width > 0 && *width > 0)
+		*pages = ceil(fdw_private->pages * (*width / schema_width));
+	else
+		*pages = 0;
+}
+
+/*
+ * Width in bytes of a value of a ROOT type, as stored in a branch.
+ */
+static int
+root_type_width(RootAttributeType atttype)
+{
+	switch (atttype)
+	{
+	case RootInt:
+	case RootUInt:
+	case RootFloat:
+		return 4;
+	case RootBool:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Estimate the share of the work done by each participant of a parallel
+ * scan, the same way the core planner does for parallel sequential scans.
+ */
+static double
+root_parallel_divisor(int parallel_workers)
+{
+	double		parallel_divisor = parallel_workers;
+	double		leader_contribution;
+
+	leader_contribution = 1.0 - (0.3 * parallel_workers);
+	if (leader_contribution > 0)
+		parallel_divisor += leader_contribution;
+
+	return parallel_divisor;
+}
+
+/*
+ * root_histogram
+ *		Count the values of a column of a ROOT table in nbins equal-width
+ *		bins between lo and hi
+ *
+ *		Bins are numbered as width_bucket numbers them: bin 0 counts values
+ *		below lo and bin nbins + 1 values at or above hi, as well as NaNs.
+ *		Entries are read by the same cursor loop as a scan of the table, with
+ *		the conditions of the optional filter checked inside it, and values
+ *		are binned a batch at a time, without going through the executor.
+ */
+Datum
+root_histogram(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	RootFdwExecutionState *festate;
+	RootBatch  *batch;
+	Oid			relid;
+	char	   *branch;
+	char	   *filter = NULL;
+	int			nbins;
+	double		lo;
+	double		hi;
+	int64	   *counts;
+	AclResult	aclresult;
+	int			i;
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(2) ||
+		PG_ARGISNULL(3) || PG_ARGISNULL(4))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("only the filter of root_histogram may be null")));
+
+	relid = PG_GETARG_OID(0);
+	branch = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	nbins = PG_GETARG_INT32(2);
+	lo = PG_GETARG_FLOAT8(3);
+	hi = PG_GETARG_FLOAT8(4);
+	if (!PG_ARGISNULL(5))
+		filter = text_to_cstring(PG_GETARG_TEXT_PP(5));
+
+	if (nbins <= 0 || nbins == INT_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_ARGUMENT_FOR_WIDTH_BUCKET_FUNCTION),
+				 errmsg("number of bins must be between 1 and %d",
+						INT_MAX - 1)));
+	if (isnan(lo) || isnan(hi) || isinf(lo) || isinf(hi) || !(lo < hi))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_ARGUMENT_FOR_WIDTH_BUCKET_FUNCTION),
+				 errmsg("lower bound must be finite and less than upper bound")));
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* The executor doesn't check permissions for us */
+	aclresult = pg_class_aclcheck(relid, GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, ACL_KIND_CLASS, get_rel_name(relid));
+
+	festate = create_execution_state(plan_histogram_scan(relid, branch,
+														 filter),
+									 CurrentMemoryContext);
+	batch = &festate->batch;
+	if (festate->nproj != 1 ||
+		festate->atttypes[festate->proj[0]] == RootBool)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("root_histogram branch must be a numeric column")));
+
+	/* Bin the values of the branch */
+	counts = (int64 *) palloc0((nbins + 2) * sizeof(int64));
+	while (fill_batch(festate) > 0)
+	{
+		bin_values(batch->values[0], batch->nrows,
+				   festate->atttypes[festate->proj[0]], lo, hi, nbins,
+				   counts);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	close_current_file(festate);
+	MemoryContextDelete(festate->scan_cxt);
+
+	/* Return one row per bin */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	for (i = 0; i <= nbins + 1; i++)
+	{
+		Datum		values[4];
+		bool		nulls[4];
+		double		low;
+		double		high;
+
+		if (i == 0)
+			low = -get_float8_infinity();
+		else
+			low = lo + (hi - lo) * (i - 1) / nbins;
+		if (i == nbins + 1)
+			high = get_float8_infinity();
+		else
+			high = (i == nbins) ? hi : lo + (hi - lo) * i / nbins;
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum(i);
+		values[1] = Float8GetDatum(low);
+		values[2] = Float8GetDatum(high);
+		values[3] = Int64GetDatum(counts[i]);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Plan "SELECT branch FROM table WHERE filter" and return the private list
+ * of the ForeignScan node scanning the table.  The filter can be any
+ * condition on the columns of the table, as long as root_fdw checks all of
+ * it in the cursor loop; the query itself is never executed.
+ */
+static List *
+plan_histogram_scan(Oid relid, const char *branch, const char *filter)
+{
+	StringInfoData sql;
+	Relation	rel;
+	TupleDesc	tupdesc;
+	char	   *attname = NULL;
+	List	   *parsetree_list;
+	List	   *querytree_list;
+	PlannedStmt *stmt;
+	ForeignScan *scan;
+	TargetEntry *tle;
+	int			i;
+
+	check_root_table(relid);
+
+	/* Branches match columns regardless of case, as in collect_attributes */
+	rel = heap_open(relid, AccessShareLock);
+	tupdesc = RelationGetDescr(rel);
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+
+		if (!attr->attisdropped &&
+			pg_strcasecmp(NameStr(attr->attname), branch) == 0)
+		{
+			attname = pstrdup(NameStr(attr->attname));
+			break;
+		}
+	}
+	heap_close(rel, AccessShareLock);
+
+	if (attname == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_COLUMN),
+				 errmsg("column \"%s\" of relation \"%s\" does not exist",
+						branch, get_rel_name(relid))));
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "SELECT %s FROM ONLY %s",
+					 quote_identifier(attname),
+					 quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)),
+												get_rel_name(relid)));
+	if (filter != NULL)
+		appendStringInfo(&sql, " WHERE %s", filter);
+
+	parsetree_list = pg_parse_query(sql.data);
+	if (list_length(parsetree_list) != 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("invalid root_histogram filter \"%s\"", filter)));
+
+	querytree_list = pg_analyze_and_rewrite(linitial_node(RawStmt,
+														  parsetree_list),
+											sql.data, NULL, 0, NULL);
+	if (list_length(querytree_list) != 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("invalid root_histogram filter \"%s\"", filter)));
+
+	stmt = pg_plan_query(linitial_node(Query, querytree_list), 0, NULL);
+
+	/* Nothing but a plain scan of the table may be needed */
+	scan = (ForeignScan *) stmt->planTree;
+	if (!IsA(scan, ForeignScan) ||
+		scan->scan.scanrelid == 0 ||
+		rt_fetch(scan->scan.scanrelid, stmt->rtable)->relid != relid ||
+		scan->scan.plan.qual != NIL ||
+		scan->scan.plan.initPlan != NIL ||
+		stmt->subplans != NIL)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("root_histogram filter must only contain conditions checked while scanning")));
+
+	tle = (TargetEntry *) linitial(scan->scan.plan.targetlist);
+	if (list_length(scan->scan.plan.targetlist) != 1 ||
+		!IsA(tle->expr, Var))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("root_histogram branch must be a column")));
+
+	return scan->fdw_private;
+}
+
+/*
+ * Count the values of a batch column into bins, computing bins the same way
+ * width_bucket does.  The bin of each value doesn't depend on the others, so
+ * the loops are free of dependencies but for the increment of the counts.
+ */
+static void
+bin_values(Datum *column, int nrows, RootAttributeType atttype,
+		   double lo, double hi, int nbins, int64 *counts)
+{
+	double		width = hi - lo;
+	int			i;
+
+	if (atttype == RootFloat)
+	{
+		for (i = 0; i < nrows; i++)
+		{
+			double		x = DatumGetFloat8(column[i]);
+			int			bin;
+
+			if (x < lo)
+				bin = 0;
+			else if (x >= hi || isnan(x))
+				bin = nbins + 1;
+			else
+				bin = (int) (((x - lo) * nbins) / width) + 1;
+			counts[bin]++;
+		}
+	}
+	else
+	{
+		for (i = 0; i < nrows; i++)
+		{
+			double		x = (double) root_datum_get_int64(column[i], atttype);
+			int			bin;
+
+			if (x < lo)
+				bin = 0;
+			else if (x >= hi)
+				bin = nbins + 1;
+			else
+				bin = (int) (((x - lo) * nbins) / width) + 1;
+			counts[bin]++;
+		}
+	}
+}
+
+/*
+ * root_zone_map_build
+ *		Build the zone map of a ROOT table, reading every entry of every
+ *		file of its shards
+ *
+ *		The smallest and greatest value of each integer, floating-point and
+ *		boolean branch of the table are recorded per file.  The zone map of
+ *		each shard is written next to its catalog, replacing any previous one, and
+ *		must be rebuilt when files are added to the shard or modified, as
+ *		zones of modified files are ignored.  Returns the number of files
+ *		with zones.
+ */
+Datum
+root_zone_map_build(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	RootFdwPlanState *fdw_private;
+	RootAttr  **branches;
+	ListCell   *lc;
+	int			nbranches = 0;
+	int			nzoned = 0;
+
+	check_root_table(relid);
+	if (!pg_class_ownercheck(relid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, ACL_KIND_CLASS,
+					   get_rel_name(relid));
+
+	fdw_private = get_plan_state(relid);
+
+	/*
+	 * Ids are not stored in branches, and are pruned by tree id ranges.
+	 * Arrays have no zone of their own.
+	 */
+	branches = (RootAttr **) palloc(list_length(fdw_private->schema) *
+									sizeof(RootAttr *));
+	foreach(lc, fdw_private->schema)
+	{
+		RootAttr   *rattr = (RootAttr *) lfirst(lc);
+
+		if (rattr->atttype != RootTreeId &&
+			rattr->atttype != RootCollectionId && !rattr->isarray)
+			branches[nbranches++] = rattr;
+	}
+
+	/* Each shard of the table has a zone map of its own */
+	foreach(lc, fdw_private->shards)
+	{
+		nzoned += build_shard_zone_map(fdw_private, lfirst_int(lc),
+									   branches, nbranches);
+	}
+
+	PG_RETURN_INT32(nzoned);
+}
+
+/*
+ * Build the zone map of a ROOT table in one of its shards.  Returns the
+ * number of files with zones.
+ */
+static int
+build_shard_zone_map(RootFdwPlanState *fdw_private, int shard,
+					 RootAttr **branches, int nbranches)
+{
+	RootShard  *rshard = get_root_shard(shard);
+	double	   *mins;
+	double	   *maxs;
+	char		path[MAXPGPATH];
+	char		tmppath[MAXPGPATH];
+	FILE	   *f;
+	volatile int nzoned = 0;
+	int			i;
+
+	mins = (double *) palloc(Max(nbranches, 1) * sizeof(double));
+	maxs = (double *) palloc(Max(nbranches, 1) * sizeof(double));
+
+	zone_map_path(path, shard, fdw_private->tree,
+				  fdw_private->is_collection);
+	snprintf(tmppath, MAXPGPATH, "%s.tmp", path);
+
+	f = AllocateFile(tmppath, PG_BINARY_W);
+	if (!f)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m", tmppath)));
+
+	/* Don't leave a partial zone map behind if a file can't be read */
+	PG_TRY();
+	{
+		for (i = 0; i < rshard->nfiles && nbranches > 0; i++)
+		{
+			RootTable  *root_table;
+			RootCursor *root_cursor;
+			struct stat st;
+			int64		n = 0;
+			int			j;
+
+			if (stat(rshard->fnames[i], &st) != 0)
+			{
+				ereport(WARNING,
+						(errcode_for_file_access(),
+						 errmsg("could not stat file \"%s\": %m",
+								rshard->fnames[i]),
+						 errdetail("The zone map has no zones for it.")));
+				continue;
+			}
+
+			root_table = get_file_table(rshard, i, fdw_private->tree,
+										fdw_private->is_collection);
+			root_cursor = init_root_cursor(root_table, nbranches);
+			if (!root_cursor)
+			{
+				elog(ERROR, "failed to initialize ROOT's cursor");
+			}
+
+			for (j = 0; j < nbranches; j++)
+			{
+				if (!set_root_cursor_attr(root_cursor, j,
+										  branches[j]->attname,
+										  branches[j]->atttype))
+				{
+					elog(ERROR, "failed to add attribute to ROOT cursor");
+				}
+			}
+
+			if (!open_root_cursor(root_cursor))
+			{
+				elog(ERROR, "failed to open ROOT cursor");
+			}
+
+			while (advance_root_cursor(root_cursor))
+			{
+				for (j = 0; j < nbranches; j++)
+				{
+					double		value;
+
+					value = get_value_as_double(root_cursor, j,
+												branches[j]->atttype);
+
+					if (n == 0 || root_float_cmp(value, mins[j]) < 0)
+						mins[j] = value;
+					if (n == 0 || root_float_cmp(value, maxs[j]) > 0)
+						maxs[j] = value;
+				}
+
+				if ((++n % ROOT_BATCH_SIZE) == 0)
+					CHECK_FOR_INTERRUPTS();
+			}
+
+			fini_root_cursor(root_cursor);
+
+			/* Files without entries have no zones */
+			if (n == 0)
+				continue;
+
+			for (j = 0; j < nbranches; j++)
+			{
+				fprintf(f, "%s\t%ld\t" INT64_FORMAT "\t%s\t%.17g\t%.17g\n",
+						rshard->fnames[i], (long) st.st_mtime,
+						(int64) st.st_size, branches[j]->attname,
+						mins[j], maxs[j]);
+			}
+			nzoned++;
+		}
+	}
+	PG_CATCH();
+	{
+		FreeFile(f);
+		unlink(tmppath);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (FreeFile(f))
+	{
+		int			save_errno = errno;
+
+		unlink(tmppath);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m", tmppath)));
+	}
+
+	(void) durable_rename(tmppath, path, ERROR);
+
+	return nzoned;
+}
+
+/*
+ * Return the work done by the scans of each foreign table of the current
+ * database, as counted by record_table_stats.
+ */
+Datum
+root_fdw_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	HASH_SEQ_STATUS status;
+	RootTableStats *stats;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Nothing was scanned yet by this backend */
+	if (root_table_stats == NULL)
+	{
+		tuplestore_donestoring(tupstore);
+		return (Datum) 0;
+	}
+
+	if (root_shared)
+		LWLockAcquire(root_shared->stats_lock, LW_SHARED);
+
+	hash_seq_init(&status, root_table_stats);
+	while ((stats = (RootTableStats *) hash_seq_search(&status)) != NULL)
+	{
+		Datum		values[9];
+		bool		nulls[9];
+
+		if (stats->key.dbid != MyDatabaseId)
+			continue;
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = ObjectIdGetDatum(stats->key.relid);
+		values[1] = Int64GetDatum(stats->scans);
+		values[2] = Int64GetDatum(stats->files_read);
+		values[3] = Int64GetDatum(stats->files_cached);
+		values[4] = Int64GetDatum(stats->bytes_read);
+		values[5] = Int64GetDatum(stats->entries_read);
+		values[6] = Int64GetDatum(stats->entries_filtered);
+		values[7] = Float8GetDatum(stats->open_time);
+		values[8] = Float8GetDatum(stats->scan_time);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	if (root_shared)
+		LWLockRelease(root_shared->stats_lock);
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}